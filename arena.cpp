@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <new>
+
+#include "arena.hpp"
+
+#include "imgui.h"
+
+namespace memory {
+
+Stats stats[MEM_COUNT];
+
+const char *tag_name[MEM_COUNT] = {
+    /* MEM_MAP */ "Map",
+    /* MEM_FRAME */ "Frame",
+    /* MEM_PROFILER */ "Profiler",
+    /* MEM_LOD */ "LOD",
+    /* MEM_PARTICLES */ "Particles",
+};
+
+void reserve(MemTag tag, size_t bytes)
+{
+    stats[tag].reserved += bytes;
+}
+
+void unreserve(MemTag tag, size_t bytes)
+{
+    stats[tag].reserved -= bytes;
+}
+
+void use(MemTag tag, size_t bytes)
+{
+    auto &s = stats[tag];
+    size_t used = s.used += bytes;
+    size_t peak = s.peak.load(std::memory_order_relaxed);
+    while (used > peak && !s.peak.compare_exchange_weak(peak, used));
+
+    s.allocations++;
+    s.frame_allocations++;
+}
+
+void unuse(MemTag tag, size_t bytes)
+{
+    stats[tag].used -= bytes;
+}
+
+void new_frame()
+{
+    for (auto &s : stats)
+        s.last_frame_allocations = s.frame_allocations.exchange(0);
+}
+
+void render_tab()
+{
+    size_t reserved = 0, used = 0;
+
+    if (ImGui::BeginTable("MemoryStats", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Subsystem");
+        ImGui::TableSetupColumn("Reserved KiB");
+        ImGui::TableSetupColumn("Used KiB");
+        ImGui::TableSetupColumn("Peak KiB");
+        ImGui::TableSetupColumn("Allocs/frame");
+        ImGui::TableSetupColumn("Allocs total");
+        ImGui::TableHeadersRow();
+
+        for (int tag = 0; tag < MEM_COUNT; tag++) {
+            auto &s = stats[tag];
+            reserved += s.reserved;
+            used += s.used;
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(tag_name[tag]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", s.reserved / 1024.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", s.used / 1024.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", s.peak / 1024.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", s.last_frame_allocations.load());
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", s.allocations.load());
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::Text("Total reserved: %.1f KiB", reserved / 1024.0);
+    ImGui::Text("Total used: %.1f KiB", used / 1024.0);
+}
+
+}
+
+void *Arena::allocate(size_t size, size_t align)
+{
+    size_t start = (offset + align - 1) & ~(align - 1);
+
+    if (current >= blocks.size() || start + size > blocks[current].size) {
+        // Move on to the next kept block large enough, or grow
+        if (current < blocks.size()) current++;
+        while (current < blocks.size() && blocks[current].size < size)
+            current++;
+
+        if (current == blocks.size()) {
+            size_t bytes = std::max(block_size, size);
+            blocks.push_back({ static_cast<char *>(::operator new(bytes)), bytes });
+            memory::reserve(tag, bytes);
+        }
+
+        start = 0;
+    }
+
+    offset = start + size;
+    used_bytes += size;
+    memory::use(tag, size);
+    return blocks[current].data + start;
+}
+
+void Arena::reset()
+{
+    memory::unuse(tag, used_bytes);
+    current = 0;
+    offset = 0;
+    used_bytes = 0;
+}
+
+void Arena::release()
+{
+    reset();
+    for (auto &block : blocks) {
+        memory::unreserve(tag, block.size);
+        ::operator delete(block.data);
+    }
+    blocks.clear();
+}
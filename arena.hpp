@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Subsystems memory is accounted to in the debug window
+enum MemTag {
+    MEM_MAP,
+    MEM_FRAME,
+    MEM_PROFILER,
+    MEM_LOD,
+    MEM_PARTICLES,
+    MEM_COUNT
+};
+
+namespace memory {
+
+struct Stats {
+    std::atomic<size_t> reserved = 0;
+    std::atomic<size_t> used = 0;
+    std::atomic<size_t> peak = 0;
+    std::atomic<size_t> allocations = 0;
+    std::atomic<size_t> frame_allocations = 0;
+    std::atomic<size_t> last_frame_allocations = 0;
+};
+
+extern Stats stats[MEM_COUNT];
+extern const char *tag_name[MEM_COUNT];
+
+// Account memory taken from or returned to the system heap
+void reserve(MemTag tag, size_t bytes);
+void unreserve(MemTag tag, size_t bytes);
+
+// Account memory handed out to callers
+void use(MemTag tag, size_t bytes);
+void unuse(MemTag tag, size_t bytes);
+
+// Roll the per frame allocation counters
+void new_frame();
+
+void render_tab();
+
+}
+
+// Bump allocator over a list of heap blocks. Allocations are never freed
+// one by one, reset() rewinds to the first block keeping the memory for
+// reuse and release() returns every block to the heap.
+class Arena {
+public:
+    explicit Arena(MemTag tag, size_t block_size = 1 << 20) : tag(tag), block_size(block_size) {}
+
+    ~Arena() { release(); }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    void *allocate(size_t size, size_t align);
+
+    template<typename T>
+    T *allocate(size_t count) { return static_cast<T *>(allocate(count * sizeof(T), alignof(T))); }
+
+    void reset();
+
+    void release();
+
+    size_t used() const { return used_bytes; }
+
+private:
+    struct Block {
+        char *data;
+        size_t size;
+    };
+
+    MemTag tag;
+    size_t block_size;
+    std::vector<Block> blocks;
+    size_t current = 0;
+    size_t offset = 0;
+    size_t used_bytes = 0;
+};
+
+// Standard allocator adaptor so containers can live in an arena
+template<typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    Arena *arena;
+
+    ArenaAllocator(Arena &arena) : arena(&arena) {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t count) { return arena->allocate<T>(count); }
+
+    void deallocate(T *, size_t) {}
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -0,0 +1,399 @@
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <algorithm>
+#include <climits>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "game.hpp"
+#include "lod.hpp"
+#include "map.hpp"
+#include "particles.hpp"
+#include "tasks.hpp"
+#include "thing.hpp"
+#include "vec2.hpp"
+
+#include "mapgen.hpp"
+
+// Microbenchmarks of the hot paths, results are written as JSON so runs
+// on different commits can be compared.
+
+// World units are tiles, the view is drawn at 50 pixels per tile
+const float TILE_PIXELS = 50.0f;
+const float VIEW_WIDTH = 32.0f;
+const float VIEW_HEIGHT = 18.0f;
+
+struct Result {
+    std::string name;
+    size_t ops;
+    double best_ns;
+    double median_ns;
+};
+
+static std::vector<Result> results;
+
+// Keeps results alive so the optimizer cannot drop the measured work
+static volatile uint64_t sink;
+
+// Time `run`, which performs `ops` operations per call, over several samples
+static void bench(const std::string &name, size_t ops, const std::function<void()> &run)
+{
+    constexpr int SAMPLES = 7;
+    const double freq = SDL_GetPerformanceFrequency();
+
+    run();
+
+    std::vector<double> samples;
+    for (int i = 0; i < SAMPLES; i++) {
+        auto start = SDL_GetPerformanceCounter();
+        run();
+        auto end = SDL_GetPerformanceCounter();
+        samples.push_back((end - start) / freq * 1e9 / ops);
+    }
+
+    std::sort(samples.begin(), samples.end());
+    results.push_back({ name, ops, samples.front(), samples[SAMPLES / 2] });
+    std::cout << name << ": " << samples[SAMPLES / 2] << " ns/op" << std::endl;
+}
+
+static void bench_map(const std::string &label, const std::string &path, SDL_Renderer *renderer)
+{
+    Map map;
+    map.init(renderer);
+
+    bench("map_load/" + label, 1, [&] {
+        if (!map.load_file(path)) panic("Failed to load generated map");
+    });
+
+    const size_t tiles = map.width() * map.height();
+    const float world_width = map.width();
+    const float world_height = map.height();
+    std::mt19937 rng(1);
+
+    // Random probe positions shared by the collision benchmarks
+    constexpr size_t PROBES = 100000;
+    std::uniform_real_distribution<float> xs(0, world_width - 1.0f);
+    std::uniform_real_distribution<float> ys(0, world_height - 1.0f);
+    std::vector<Collider> probes;
+    for (size_t i = 0; i < PROBES; i++)
+        probes.push_back(Collider({ to_fixed(xs(rng)), to_fixed(ys(rng)), FIXED_ONE, FIXED_ONE }));
+    auto probe_pos = [](const Collider &probe) {
+        return WorldPos{ WorldCoord::at(probe.rect.x), WorldCoord::at(probe.rect.y) };
+    };
+
+    bench("map_chunk_decode/" + label, map.chunk_count(), [&] {
+        Material out[CHUNK_SIZE * CHUNK_SIZE];
+        uint64_t sum = 0;
+        for (size_t chunk = 0; chunk < map.chunk_count(); chunk++) {
+            map.chunk_tiles(chunk, out);
+            sum += out[chunk % std::size(out)];
+        }
+        sink = sum;
+    });
+
+    bench("map_colliding/" + label, PROBES, [&] {
+        Tile scratch[8];
+        uint64_t hits = 0;
+        for (auto &probe : probes)
+            hits += map.colliding(probe, scratch).len;
+        sink = hits;
+    });
+
+    // A large zoomed out view culled in one band, then in bands on the pool
+    // the way a frame does it
+    {
+        Camera camera = { {}, std::min(world_width, 512.0f), std::min(world_height, 256.0f) };
+        SDL_Rect area = map.visible_area(camera);
+        std::vector<TileDraw> out(area.w * area.h);
+
+        bench("map_cull/" + label, 1, [&] {
+            sink = map.cull_rows(camera, TILE_PIXELS, area, area.y, area.y + area.h, out.data());
+        });
+
+        WorkerPool pool;
+        TaskGraph graph;
+        size_t bands = pool.threads() + 1;
+        std::vector<size_t> counts(bands);
+
+        bench("map_cull_parallel/" + label, 1, [&] {
+            graph.clear();
+            for (size_t band = 0; band < bands; band++) {
+                graph.add("Cull band", [&, band] {
+                    int begin = area.y + int(band * area.h / bands);
+                    int end = area.y + int((band + 1) * area.h / bands);
+                    counts[band] = map.cull_rows(camera, TILE_PIXELS, area, begin, end, out.data() + (begin - area.y) * area.w);
+                });
+            }
+            graph.run(&pool);
+            sink = counts[0];
+        });
+
+        std::cout << "\t(" << bands << " bands on " << pool.threads() << " workers)" << std::endl;
+    }
+
+    if (renderer) {
+        constexpr size_t FRAMES = 50;
+        std::uniform_real_distribution<float> cx(0, std::max(0.0f, world_width - VIEW_WIDTH));
+        std::uniform_real_distribution<float> cy(0, std::max(0.0f, world_height - VIEW_HEIGHT));
+
+        Arena frame(MEM_FRAME);
+        bench("map_render/" + label, FRAMES, [&] {
+            for (size_t i = 0; i < FRAMES; i++) {
+                Camera camera = { { WorldCoord::at(to_fixed(cx(rng))), WorldCoord::at(to_fixed(cy(rng))) }, VIEW_WIDTH, VIEW_HEIGHT };
+                map.render(renderer, camera, TILE_PIXELS, frame);
+                frame.reset();
+            }
+        });
+    }
+
+    Thing thing;
+    thing.init(nullptr, 1.0f);
+    thing.spawn(map.spawn());
+
+    constexpr size_t TICKS = 100000;
+    const int64_t max_x = to_fixed(world_width - thing.size);
+    const int64_t max_y = to_fixed(world_height - thing.size);
+    bench("thing_update/" + label, TICKS, [&] {
+        for (size_t i = 0; i < TICKS; i++) {
+            thing.move_input(i & 1024 ? 1.0f : -1.0f);
+            thing.update(TICK_MS);
+            thing.pos.x = WorldCoord::at(std::clamp<int64_t>(thing.pos.x.fixed(), 0, max_x));
+            thing.pos.y = WorldCoord::at(std::clamp<int64_t>(thing.pos.y.fixed(), 0, max_y));
+        }
+    });
+
+    bench("thing_collisions/" + label, PROBES, [&] {
+        Tile scratch[8];
+        for (auto &probe : probes) {
+            thing.spawn(probe_pos(probe));
+            thing.collisions(map.colliding(thing.collider, scratch));
+        }
+        sink = uint64_t(thing.pos.x.fixed());
+    });
+
+    // The particle budget is 200k live ones in 2 ms, update and build
+    // together. Bursts start in open tiles near each other, particles far
+    // from the rest would be culled, and live through every sample.
+    {
+        constexpr size_t LIVE = 200000;
+        constexpr size_t BURST = 100;
+        constexpr int64_t NEAR = 128;
+        Particles particles;
+        particles.init(LIVE);
+        WorldPos first;
+        for (auto &probe : probes) {
+            if (particles.stats().live == LIVE) break;
+            auto pos = probe_pos(probe);
+            if (material_solid(map.tile(pos.y.tile(), pos.x.tile()))) continue;
+            if (particles.stats().live == 0) {
+                first = pos;
+                particles.follow(first);
+            } else if (std::abs(pos.x.tile() - first.x.tile()) > NEAR || std::abs(pos.y.tile() - first.y.tile()) > NEAR)
+                continue;
+            particles.emit(pos, material_table.color[M_DIRT], BURST, 0.006f, 1e9f);
+        }
+
+        bench("particles_update/" + label, LIVE, [&] {
+            particles.update(map, TICK_MS);
+            sink = particles.stats().live;
+        });
+
+        Camera everything = { {}, world_width, world_height };
+        bench("particles_build/" + label, LIVE, [&] {
+            particles.build(everything, 1.0f);
+            sink = particles.stats().drawn;
+        });
+
+        std::cout << "\t(" << particles.stats().live << " particles live after the runs)" << std::endl;
+    }
+
+    // The whole LOD built and uploaded, then what it keeps on the CPU
+    // next to the packed tiles
+    size_t lod_bytes = 0;
+    if (renderer) {
+        LodPyramid lod;
+        lod.init(renderer, material_table.texture.data(), map.generated());
+
+        bench("lod_build/" + label, map.chunk_count(), [&] {
+            lod.reset(map.width(), map.height());
+            Material out[CHUNK_SIZE * CHUNK_SIZE];
+            for (size_t chunk = 0; chunk < map.chunk_count(); chunk++) {
+                map.chunk_tiles(chunk, out);
+                lod.update(chunk / map.chunks_x(), chunk % map.chunks_x(), out);
+            }
+            while (lod.pending() > 0) {
+                lod.upload(LodPyramid::MAX_READY);
+                SDL_Delay(0);
+            }
+            lod.upload(INT_MAX);
+        });
+
+        lod_bytes = lod.cpu_bytes();
+        std::cout << "\t(LOD: " << lod_bytes << " bytes on the CPU, " << lod.page_bytes() << " in pages)" << std::endl;
+    }
+
+    std::cout << "\t(" << tiles << " tiles, " << double(map.packed_bytes()) / tiles << " bytes per tile packed, "
+              << double(map.packed_bytes() + lod_bytes) / tiles << " with the LOD)" << std::endl;
+}
+
+static void bench_vec2()
+{
+    constexpr size_t COUNT = 1 << 16;
+    std::vector<Vec2<float>> a(COUNT), b(COUNT);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-100, 100);
+    for (size_t i = 0; i < COUNT; i++) {
+        a[i] = { dist(rng), dist(rng) };
+        b[i] = { dist(rng), dist(rng) };
+    }
+
+    bench("vec2_add_mul", COUNT, [&] {
+        for (size_t i = 0; i < COUNT; i++)
+            a[i] = (a[i] + b[i]) * 0.5f;
+        sink = uint64_t(a[0].x);
+    });
+
+    bench("vec2_compound", COUNT, [&] {
+        for (size_t i = 0; i < COUNT; i++) {
+            a[i] += b[i];
+            a[i] *= 0.5f;
+        }
+        sink = uint64_t(a[0].x);
+    });
+
+    bench("vec2_abs_compare", COUNT, [&] {
+        Vec2<float> threshold = { 1, 1 };
+        uint64_t count = 0;
+        for (size_t i = 0; i < COUNT; i++)
+            count += (a[i] - b[i]).abs() < threshold;
+        sink = count;
+    });
+}
+
+static bool write_json(const std::string &path)
+{
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    file << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        auto &result = results[i];
+        file << "    {\"name\": \"" << result.name
+             << "\", \"ops\": " << result.ops
+             << ", \"best_ns_per_op\": " << result.best_ns
+             << ", \"median_ns_per_op\": " << result.median_ns
+             << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    file << "  ]\n}\n";
+
+    return bool(file);
+}
+
+// Whole argument as an unsigned number, false for anything else
+template<typename T>
+static bool parse_number(const std::string &text, T &value)
+{
+    std::istringstream stream(text);
+    return !text.empty() && std::isdigit((unsigned char)text[0]) && (stream >> value) && stream.eof();
+}
+
+static void usage(const char *program)
+{
+    std::cout << "Usage: " << program << " [--out <json>] [--width <tiles>] [--height <tiles>]"
+              << " [--seed <n>] [--mix D:80,C:8,...] [--generate <map>]" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string out = "bench.json";
+    std::string generate;
+    MapGenConfig config;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        std::string arg = argv[i], value = argv[++i];
+        if (arg == "--out") {
+            out = value;
+        } else if (arg == "--width" || arg == "--height" || arg == "--seed") {
+            bool ok = arg == "--width" ? parse_number(value, config.width)
+                : arg == "--height" ? parse_number(value, config.height)
+                : parse_number(value, config.seed);
+            if (!ok) {
+                std::cout << "Invalid " << arg << ": " << value << std::endl;
+                return 1;
+            }
+        } else if (arg == "--mix") {
+            if (!parse_mix(value, config.mix)) {
+                std::cout << "Invalid mix: " << value << std::endl;
+                return 1;
+            }
+        } else if (arg == "--generate") {
+            generate = value;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!valid_config(config)) {
+        std::cout << "Invalid map config: needs columns, at least 2 rows and a mix of known materials" << std::endl;
+        return 1;
+    }
+
+    // Only write a map when asked to
+    if (!generate.empty()) {
+        if (!generate_map(generate, config)) {
+            std::cout << "Failed to generate map: " << generate << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    if (SDL_Init(SDL_INIT_TIMER) != 0 || IMG_Init(IMG_INIT_PNG) != IMG_INIT_PNG)
+    {
+        std::cout << "Unable to initialize SDL2: " << SDL_GetError() << std::endl;
+        return 1;
+    }
+
+    // Software renderer drawing into a memory surface, no window needed
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, int(VIEW_WIDTH * TILE_PIXELS), int(VIEW_HEIGHT * TILE_PIXELS), 32, SDL_PIXELFORMAT_RGBA8888);
+    SDL_Renderer *renderer = surface ? SDL_CreateSoftwareRenderer(surface) : nullptr;
+    if (renderer == nullptr)
+        std::cout << "No software renderer, skipping render benchmarks: " << SDL_GetError() << std::endl;
+
+    const std::string path = "bench_generated.map";
+    if (!generate_map(path, config)) {
+        std::cout << "Failed to generate map: " << path << std::endl;
+        return 1;
+    }
+
+    bench_map(std::to_string(config.width) + "x" + std::to_string(config.height), path, renderer);
+    bench_map("test", "maps/test.map", renderer);
+    bench_vec2();
+
+    std::remove(path.c_str());
+
+    if (!write_json(out)) {
+        std::cout << "Failed to write results: " << out << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << out << std::endl;
+
+    if (renderer) SDL_DestroyRenderer(renderer);
+    if (surface) SDL_FreeSurface(surface);
+    SDL_Quit();
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#include "material.hpp"
+
+#include "mapgen.hpp"
+
+bool parse_mix(const std::string &text, std::vector<MapMix> &mix)
+{
+    std::istringstream stream(text);
+    std::string item;
+    mix.clear();
+
+    while (std::getline(stream, item, ','))
+    {
+        if (item.size() < 3 || item[1] != ':')
+            return false;
+
+        try {
+            mix.push_back({ item[0], std::stof(item.substr(2)) });
+        } catch (const std::exception &) {
+            return false;
+        }
+    }
+
+    return !mix.empty();
+}
+
+bool valid_config(const MapGenConfig &config)
+{
+    // The surface walk stays between row 1 and the last row in int
+    if (config.width == 0 || config.height < 2 || config.height > size_t(INT_MAX))
+        return false;
+
+    if (!(config.sky >= 0.0f && config.sky <= 1.0f))
+        return false;
+
+    float total = 0.0f;
+    for (auto &entry : config.mix) {
+        if (material_table.by_symbol[uint8_t(entry.material)] == M_COUNT)
+            return false;
+        if (!std::isfinite(entry.weight) || entry.weight < 0.0f)
+            return false;
+        total += entry.weight;
+    }
+    return total > 0.0f;
+}
+
+bool generate_map(const std::string &path, const MapGenConfig &config)
+{
+    if (!valid_config(config))
+        return false;
+
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    std::mt19937 rng(config.seed);
+    std::vector<float> weights;
+    for (auto &entry : config.mix)
+        weights.push_back(entry.weight);
+    std::discrete_distribution<size_t> pick(weights.begin(), weights.end());
+    std::uniform_int_distribution<int> step(-1, 1);
+    std::uniform_int_distribution<int> flower(0, 15);
+
+    // Surface height per column as a clamped random walk
+    std::vector<size_t> surface(config.width);
+    int level = config.height * config.sky;
+    for (auto &height : surface) {
+        level = std::clamp(level + step(rng), 1, int(config.height) - 1);
+        height = level;
+    }
+
+    size_t spawn_x = config.width / 2;
+    size_t spawn_y = surface[spawn_x] > 1 ? surface[spawn_x] - 2 : 0;
+
+    file << "map " << config.width << " " << config.height
+         << " spawn " << spawn_x << " " << spawn_y << "\n";
+
+    std::string line(config.width, ' ');
+    for (size_t row = 0; row < config.height; row++)
+    {
+        for (size_t column = 0; column < config.width; column++)
+        {
+            size_t top = surface[column];
+            if (row < top)
+                line[column] = (row + 1 == top && flower(rng) == 0) ? 'F' : ' ';
+            else if (row == top)
+                line[column] = 'G';
+            else
+                line[column] = config.mix[pick(rng)].material;
+        }
+        file << line << "\n";
+    }
+
+    return bool(file);
+}
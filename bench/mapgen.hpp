@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Share of solid ground per map character, e.g. {'D', 70}, {'C', 10}
+struct MapMix {
+    char material;
+    float weight;
+};
+
+struct MapGenConfig {
+    size_t width = 1024;
+    size_t height = 256;
+    uint32_t seed = 1;
+    // Fraction of the height above the average surface
+    float sky = 0.3f;
+    std::vector<MapMix> mix = { {'D', 80}, {'C', 8}, {'L', 4}, {'W', 8} };
+};
+
+// Parse "D:80,C:8,L:4" into a mix, returns false on malformed input
+bool parse_mix(const std::string &text, std::vector<MapMix> &mix);
+
+// At least one column and two rows, a sky fraction in [0, 1] and a mix of
+// known map characters with a positive total weight
+bool valid_config(const MapGenConfig &config);
+
+// Write a synthetic map in the .map format loaded by Map::load_file,
+// returns false for an invalid config
+bool generate_map(const std::string &path, const MapGenConfig &config);
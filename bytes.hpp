@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Byte buffer shared by the snapshot and network formats. Fields are
+// copied in host byte order, the formats are little endian so only
+// little endian hosts can read and write them
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Snapshot and network formats assume a little endian host"
+#endif
+
+struct ByteWriter {
+    std::vector<uint8_t> bytes;
+
+    template<typename T>
+    void put(const T &value)
+    {
+        auto p = reinterpret_cast<const uint8_t *>(&value);
+        bytes.insert(bytes.end(), p, p + sizeof(value));
+    }
+
+    void put_bytes(const void *data, size_t len)
+    {
+        auto p = static_cast<const uint8_t *>(data);
+        bytes.insert(bytes.end(), p, p + len);
+    }
+
+    void put_varint(uint32_t value)
+    {
+        while (value >= 0x80) {
+            bytes.push_back(uint8_t(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back(uint8_t(value));
+    }
+
+    // Varint length, u8 value pairs, short for mostly uniform data
+    void put_runs(const uint8_t *data, size_t len)
+    {
+        size_t i = 0;
+        while (i < len) {
+            size_t run = 1;
+            while (i + run < len && data[i + run] == data[i])
+                run++;
+
+            put_varint(run);
+            put(data[i]);
+            i += run;
+        }
+    }
+
+    size_t size() const { return bytes.size(); }
+};
+
+struct ByteReader {
+    const uint8_t *at;
+    const uint8_t *end;
+
+    template<typename T>
+    bool get(T &value)
+    {
+        return get_bytes(&value, sizeof(value));
+    }
+
+    bool get_bytes(void *data, size_t len)
+    {
+        if (size_t(end - at) < len) return false;
+        std::memcpy(data, at, len);
+        at += len;
+        return true;
+    }
+
+    bool get_varint(uint32_t &value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 35 && at < end; shift += 7) {
+            uint8_t byte = *at++;
+            value |= uint32_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    // Fails unless the runs cover exactly len bytes
+    bool get_runs(uint8_t *data, size_t len)
+    {
+        size_t i = 0;
+        while (i < len) {
+            uint32_t run;
+            uint8_t value;
+            if (!get_varint(run) || !get(value) || run == 0 || run > len - i)
+                return false;
+
+            std::memset(data + i, value, run);
+            i += run;
+        }
+        return true;
+    }
+};
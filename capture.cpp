@@ -0,0 +1,225 @@
+#include <SDL2/SDL_image.h>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+#include "capture.hpp"
+#include "profile.hpp"
+
+CaptureFormat capture_format(const std::string &path)
+{
+    auto extension = std::filesystem::path(path).extension();
+    return extension == ".rgba" || extension == ".raw" ? CAPTURE_RAW : CAPTURE_PNG;
+}
+
+FrameCapture::FrameCapture()
+{
+    for (size_t i = 0; i < RING_SIZE; i++)
+        free_frames.push_back(i);
+    worker = std::thread(&FrameCapture::run, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+bool FrameCapture::start(const std::string &path, CaptureFormat format)
+{
+    // Fail here rather than on every frame of the writer
+    if (format == CAPTURE_PNG) {
+        std::error_code error;
+        std::filesystem::create_directories(path, error);
+        if (error) {
+            std::cout << "Failed to create capture directory: " << path << std::endl;
+            return false;
+        }
+    } else if (!std::ofstream(path, std::ios::binary | std::ios::app)) {
+        // Not truncated yet, the writer may still be writing the previous
+        // recording there. It truncates at the first frame of this one.
+        std::cout << "Failed to open capture stream: " << path << std::endl;
+        return false;
+    }
+
+    this->path = path;
+    this->format = format;
+    next_index = 0;
+    captured = 0;
+    dropped = 0;
+    {
+        // Frames of the previous recording still queued no longer count
+        std::lock_guard lock(mutex);
+        session++;
+        written = 0;
+        rejected = 0;
+    }
+    return true;
+}
+
+void FrameCapture::stop()
+{
+    path.clear();
+    read_ms = 0.0f;
+}
+
+void FrameCapture::screenshot(const std::string &path)
+{
+    screenshot_path = path;
+}
+
+void FrameCapture::read(SDL_Renderer *renderer)
+{
+    bool shot = !screenshot_path.empty();
+    if (!shot && !recording()) return;
+
+    PROFILE_ZONE("FrameCapture::read");
+
+    auto start = SDL_GetPerformanceCounter();
+
+    int width = 0, height = 0;
+    if (SDL_GetRendererOutputSize(renderer, &width, &height) != 0) return;
+
+    // A screenshot waits for a free frame instead of being dropped
+    if (shot && read_frame(renderer, width, height, true))
+        screenshot_path.clear();
+
+    if (recording()) {
+        captured++;
+        if (!read_frame(renderer, width, height, false))
+            dropped++;
+    }
+
+    read_ms = (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+}
+
+bool FrameCapture::read_frame(SDL_Renderer *renderer, int width, int height, bool screenshot)
+{
+    size_t index;
+    {
+        std::lock_guard lock(mutex);
+        if (free_frames.empty()) return false;
+
+        index = free_frames.back();
+        free_frames.pop_back();
+    }
+
+    // Only allocates when the window size changes
+    Frame &frame = ring[index];
+    frame.pixels.resize(size_t(width) * height * 4);
+    frame.width = width;
+    frame.height = height;
+    frame.screenshot = screenshot;
+    frame.format = screenshot ? CAPTURE_PNG : format;
+    frame.path = screenshot ? screenshot_path : path;
+    frame.session = session;
+    frame.index = screenshot ? 0 : next_index++;
+
+    bool read = SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_RGBA32, frame.pixels.data(), width * 4) == 0;
+    if (!read)
+        std::cout << "Failed to read back frame: " << SDL_GetError() << std::endl;
+
+    {
+        std::lock_guard lock(mutex);
+        if (read)
+            filled.push_back(index);
+        else
+            free_frames.push_back(index);
+    }
+    wake.notify_one();
+    return read;
+}
+
+CaptureStats FrameCapture::stats() const
+{
+    std::lock_guard lock(mutex);
+    return { captured, written, dropped + rejected, read_ms, write_ms, filled.size() };
+}
+
+void FrameCapture::run()
+{
+    while (true)
+    {
+        size_t index;
+        {
+            std::unique_lock lock(mutex);
+            wake.wait(lock, [&] { return stopping || !filled.empty(); });
+
+            // Frames already read still get written on shutdown
+            if (filled.empty()) return;
+
+            index = filled.front();
+            filled.pop_front();
+        }
+
+        write(ring[index]);
+
+        {
+            std::lock_guard lock(mutex);
+            free_frames.push_back(index);
+        }
+    }
+}
+
+void FrameCapture::count(const Frame &frame, size_t &counter)
+{
+    std::lock_guard lock(mutex);
+    if (frame.session == session)
+        counter++;
+}
+
+void FrameCapture::write(const Frame &frame)
+{
+    PROFILE_ZONE("FrameCapture::write");
+
+    auto start = SDL_GetPerformanceCounter();
+
+    if (frame.format == CAPTURE_PNG) {
+        std::string file = frame.path;
+        if (!frame.screenshot) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/frame_%06u.png", frame.index);
+            file += name;
+        }
+
+        SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom((void *)frame.pixels.data(), frame.width, frame.height,
+                                                                  32, frame.width * 4, SDL_PIXELFORMAT_RGBA32);
+        bool saved = surface && IMG_SavePNG(surface, file.c_str()) == 0;
+        SDL_FreeSurface(surface);
+        if (!saved) {
+            std::cout << "Failed to write frame: " << file << std::endl;
+            if (!frame.screenshot) count(frame, rejected);
+            return;
+        }
+
+        if (frame.screenshot)
+            std::cout << "Wrote " << file << std::endl;
+    } else {
+        // The first frame of a recording fixes the size of the stream
+        if (frame.session != stream_session) {
+            stream.close();
+            stream.clear();
+            stream.open(frame.path, std::ios::binary | std::ios::trunc);
+            stream_session = frame.session;
+            stream_width = frame.width;
+            stream_height = frame.height;
+        }
+
+        if (frame.width != stream_width || frame.height != stream_height || !stream) {
+            count(frame, rejected);
+            return;
+        }
+
+        // Flushed every frame, the stream stays open until the next recording
+        stream.write((const char *)frame.pixels.data(), frame.pixels.size());
+        stream.flush();
+    }
+
+    if (!frame.screenshot)
+        count(frame, written);
+    write_ms = (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum CaptureFormat {
+    // One numbered PNG a frame inside a directory
+    CAPTURE_PNG,
+    // Every frame appended to one file as RGBA8 rows, top to bottom. Play
+    // it back with ffmpeg -f rawvideo -pixel_format rgba -video_size WxH.
+    CAPTURE_RAW,
+};
+
+// Paths ending in .rgba or .raw are raw streams, anything else a directory
+CaptureFormat capture_format(const std::string &path);
+
+struct CaptureStats {
+    size_t captured = 0;
+    size_t written = 0;
+    // No buffer was free, or the frame did not match the stream size
+    size_t dropped = 0;
+    // Reading back the last frame, the only cost the frame itself pays
+    float read_ms = 0.0f;
+    // Encoding and writing the last frame on the writer thread
+    float write_ms = 0.0f;
+    // Read and waiting for the writer
+    size_t queued = 0;
+};
+
+// Records what the window shows without stalling on the disk. Frames are
+// read into a small ring of buffers and encoded and written by a writer
+// thread. When the writer falls behind and no buffer is free, frames are
+// dropped instead of waiting for it.
+class FrameCapture {
+public:
+    // Buffers in the ring, how many frames the writer may lag behind
+    static constexpr size_t RING_SIZE = 4;
+
+    FrameCapture();
+
+    ~FrameCapture();
+
+    // Record every frame read from now on
+    bool start(const std::string &path, CaptureFormat format);
+
+    // Frames already read still get written
+    void stop();
+
+    bool recording() const { return !path.empty(); }
+
+    // Save the next frame read as a PNG, even while not recording
+    void screenshot(const std::string &path);
+
+    // Call after drawing and right before SDL_RenderPresent, the contents of
+    // the back buffer are undefined once presented. Does nothing unless
+    // recording or a screenshot was asked for.
+    void read(SDL_Renderer *renderer);
+
+    // Main thread only
+    CaptureStats stats() const;
+
+private:
+    struct Frame {
+        std::vector<uint8_t> pixels;
+        int width = 0;
+        int height = 0;
+        bool screenshot = false;
+        CaptureFormat format = CAPTURE_PNG;
+        // The screenshot file, or the directory or stream of the recording
+        std::string path;
+        // Recordings started so far, the writer reopens the stream on a new one
+        uint32_t session = 0;
+        uint32_t index = 0;
+    };
+
+    // Read into a free frame and queue it, false when none was free
+    bool read_frame(SDL_Renderer *renderer, int width, int height, bool screenshot);
+
+    void run();
+
+    void write(const Frame &frame);
+
+    // Add a frame to written or rejected unless a newer recording started
+    void count(const Frame &frame, size_t &counter);
+
+    std::thread worker;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    // Indices into the ring, a frame is in one of them or being read or written
+    Frame ring[RING_SIZE];
+    std::vector<size_t> free_frames;
+    std::deque<size_t> filled;
+
+    // Main thread only
+    std::string path;
+    CaptureFormat format = CAPTURE_PNG;
+    std::string screenshot_path;
+    uint32_t next_index = 0;
+    size_t captured = 0;
+    size_t dropped = 0;
+    float read_ms = 0.0f;
+
+    // Writer thread only
+    std::ofstream stream;
+    uint32_t stream_session = 0;
+    int stream_width = 0;
+    int stream_height = 0;
+
+    // Guarded by mutex, only changed by the main thread. The counts are
+    // of the current recording.
+    uint32_t session = 0;
+    size_t written = 0;
+    size_t rejected = 0;
+
+    std::atomic<float> write_ms = 0.0f;
+};
@@ -0,0 +1,323 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "client.hpp"
+#include "game.hpp"
+#include "profile.hpp"
+
+// Unacknowledged commands repeated in every packet, covers lost packets
+constexpr size_t REDUNDANT_COMMANDS = 8;
+
+// Commands kept for prediction, a second of input
+constexpr size_t MAX_HISTORY = 120;
+
+constexpr uint32_t CONNECT_RETRY_TICKS = 30;
+
+bool Client::connect(const NetAddress &server)
+{
+    this->server = server;
+    player = 0;
+    refused = false;
+    latest = 0;
+    quiet_ticks = 0;
+    history.clear();
+    for (auto &snapshot : received) snapshot = {};
+
+    if (!socket.open(0, false))
+        return false;
+
+    send_connect();
+    return true;
+}
+
+void Client::send_connect()
+{
+    ByteWriter packet;
+    put_header(packet, P_CONNECT);
+    socket.send(server, packet);
+}
+
+bool Client::wait_welcome(uint32_t timeout_ms)
+{
+    constexpr uint32_t RETRY_MS = 100;
+
+    uint8_t buffer[2048];
+    NetAddress from;
+    auto start = SDL_GetTicks();
+
+    while (!connected() && !refused && SDL_GetTicks() - start < timeout_ms)
+    {
+        while (size_t len = socket.receive(from, buffer, sizeof(buffer))) {
+            ByteReader packet = { buffer, buffer + len };
+            PacketKind kind;
+            if (from == server && get_header(packet, kind) && kind == P_WELCOME)
+                handle_welcome(packet);
+        }
+
+        if (!connected() && !refused) {
+            SDL_Delay(RETRY_MS);
+            send_connect();
+        }
+    }
+
+    return connected();
+}
+
+void Client::handle_welcome(ByteReader &packet)
+{
+    uint16_t id, path_len;
+    uint64_t materials;
+    if (!packet.get(id) || !packet.get(materials) || !packet.get(path_len))
+        return;
+
+    // Tiles would collide differently here than on the server
+    if (materials != material_hash()) {
+        if (!refused)
+            std::cout << "Server " << server.str() << " uses different materials" << std::endl;
+        refused = true;
+        return;
+    }
+
+    server_map.resize(path_len);
+    if (!packet.get_bytes(server_map.data(), path_len))
+        return;
+
+    if (!connected())
+        std::cout << "Joined " << server.str() << " as player " << id << std::endl;
+    player = id;
+}
+
+void Client::disconnect()
+{
+    if (!connected()) return;
+
+    ByteWriter packet;
+    put_header(packet, P_DISCONNECT);
+    socket.send(server, packet);
+    socket.close();
+    player = 0;
+}
+
+void Client::poll(Map &map)
+{
+    PROFILE_ZONE("Client::poll");
+
+    uint8_t buffer[2048];
+    NetAddress from;
+
+    while (size_t len = socket.receive(from, buffer, sizeof(buffer)))
+    {
+        if (!(from == server)) continue;
+
+        ByteReader packet = { buffer, buffer + len };
+        PacketKind kind;
+        if (!get_header(packet, kind))
+            continue;
+
+        quiet_ticks = 0;
+
+        switch (kind)
+        {
+            case P_WELCOME:
+                handle_welcome(packet);
+                break;
+
+            case P_SNAPSHOT:
+                if (connected()) handle_snapshot(packet, map);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+void Client::handle_snapshot(ByteReader &packet, Map &map)
+{
+    uint32_t id, baseline, processed;
+    if (!packet.get(id) || !packet.get(baseline) || !packet.get(processed))
+        return;
+
+    // Late or repeated, a newer state is already known
+    if (id <= latest)
+        return;
+
+    const Received &base = received[baseline % RECEIVED_HISTORY];
+    if (baseline != 0 && base.id != baseline)
+        return;
+
+    Received next;
+    next.id = id;
+    if (baseline != 0) next.things = base.things;
+
+    auto by_id = [](auto &entry, uint16_t id) { return entry.first < id; };
+
+    uint32_t removed, changed, chunks;
+    if (!packet.get_varint(removed))
+        return;
+
+    for (uint32_t i = 0; i < removed; i++) {
+        uint32_t gone;
+        if (!packet.get_varint(gone))
+            return;
+
+        auto it = std::lower_bound(next.things.begin(), next.things.end(), uint16_t(gone), by_id);
+        if (it != next.things.end() && it->first == gone)
+            next.things.erase(it);
+    }
+
+    if (!packet.get_varint(changed))
+        return;
+
+    for (uint32_t i = 0; i < changed; i++) {
+        uint32_t player_id;
+        if (!packet.get_varint(player_id))
+            return;
+
+        auto it = std::lower_bound(next.things.begin(), next.things.end(), uint16_t(player_id), by_id);
+        if (it == next.things.end() || it->first != player_id)
+            it = next.things.insert(it, { uint16_t(player_id), ThingState{} });
+
+        if (!get_thing_delta(packet, it->second))
+            return;
+    }
+
+    if (!packet.get_varint(chunks))
+        return;
+
+    // Every chunk is checked on a copy of the reader first, a malformed
+    // packet changes nothing
+    Material tiles[CHUNK_SIZE * CHUNK_SIZE];
+    uint8_t delta[CHUNK_SIZE * CHUNK_SIZE];
+    ByteReader check = packet;
+    for (uint32_t i = 0; i < chunks; i++) {
+        uint32_t chunk;
+        if (!check.get_varint(chunk) || !check.get_runs(delta, std::size(delta)) || chunk >= map.chunk_count())
+            return;
+
+        map.chunk_source(chunk, tiles);
+        for (size_t t = 0; t < std::size(delta); t++)
+            if ((tiles[t] ^ delta[t]) >= M_COUNT) return;
+    }
+
+    for (uint32_t i = 0; i < chunks; i++) {
+        uint32_t chunk;
+        packet.get_varint(chunk);
+        packet.get_runs(delta, std::size(delta));
+
+        map.chunk_source(chunk, tiles);
+        for (size_t t = 0; t < std::size(delta); t++)
+            tiles[t] = Material(tiles[t] ^ delta[t]);
+        map.set_chunk(chunk, tiles);
+    }
+
+    others.clear();
+    for (auto &[owner, state] : next.things) {
+        if (owner == player) {
+            server_state = state;
+            processed_seq = processed;
+            fresh = true;
+        } else {
+            others.push_back({ owner, state });
+        }
+    }
+
+    received[id % RECEIVED_HISTORY] = std::move(next);
+    latest = id;
+    snapshots++;
+}
+
+void Client::input(const Input &input)
+{
+    switch (input.kind)
+    {
+        case I_MOVE:
+            current.dir = input.dir > 0 ? 1 : input.dir < 0 ? -1 : 0;
+            break;
+
+        case I_STOP:
+            current.dir = 0;
+            break;
+
+        case I_JUMP:
+            current.jump = true;
+            break;
+
+        case I_EDIT:
+            if (current.edit_count < MAX_COMMAND_EDITS)
+                current.edits[current.edit_count++] = { input.row, input.column, input.material };
+            break;
+
+        default:
+            break;
+    }
+}
+
+void Client::predict(Thing &thing, Map &map)
+{
+    if (!fresh) return;
+    fresh = false;
+
+    PROFILE_ZONE("Client::predict");
+
+    while (!history.empty() && history.front().seq <= processed_seq)
+        history.pop_front();
+
+    WorldPos predicted = thing.pos;
+    thing.restore(server_state);
+
+    // Edits were applied to the map when made, only movement runs again
+    Tile tiles[8];
+    for (auto &command : history) {
+        apply_command(thing, command);
+        step_thing(thing, map, TICK_MS, tiles);
+    }
+
+    // Input of this tick was applied before the rewind
+    apply_command(thing, current);
+
+    constexpr float CORRECTION_EPSILON = 0.0002f;
+    Vec2<float> error = thing.pos.minus(predicted);
+    if (std::abs(error.x) > CORRECTION_EPSILON || std::abs(error.y) > CORRECTION_EPSILON)
+        corrections++;
+}
+
+void Client::send(const Camera &view)
+{
+    quiet_ticks++;
+
+    if (!connected()) {
+        if (quiet_ticks % CONNECT_RETRY_TICKS == 0)
+            send_connect();
+        return;
+    }
+
+    current.seq = next_seq++;
+    history.push_back(current);
+    if (history.size() > MAX_HISTORY)
+        history.pop_front();
+
+    // Jumps and edits happen once, the direction is held
+    current.jump = false;
+    current.edit_count = 0;
+
+    uint32_t tiles[4] = {
+        uint32_t(std::clamp<int64_t>(view.pos.x.tile(), 0, UINT32_MAX)),
+        uint32_t(std::clamp<int64_t>(view.pos.y.tile(), 0, UINT32_MAX)),
+        uint32_t(std::clamp(std::ceil(view.w), 0.0f, 65535.0f)),
+        uint32_t(std::clamp(std::ceil(view.h), 0.0f, 65535.0f)),
+    };
+
+    size_t count = std::min(history.size(), REDUNDANT_COMMANDS);
+
+    ByteWriter packet;
+    put_header(packet, P_COMMANDS);
+    packet.put(latest);
+    packet.put_bytes(tiles, sizeof(tiles));
+    packet.put_varint(count);
+    for (size_t i = history.size() - count; i < history.size(); i++)
+        put_command(packet, history[i]);
+
+    socket.send(server, packet);
+}
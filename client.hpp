@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "input.hpp"
+#include "map.hpp"
+#include "net.hpp"
+#include "thing.hpp"
+
+// Connection to a Server. The local Thing is predicted from the player's
+// own commands and corrected whenever a snapshot says where it really is.
+class Client {
+public:
+    ~Client() { disconnect(); }
+
+    bool connect(const NetAddress &server);
+
+    // Block until the server accepts, snapshots before that are dropped
+    bool wait_welcome(uint32_t timeout_ms);
+
+    void disconnect();
+
+    // Handle pending packets, chunk updates go straight into the map
+    void poll(Map &map);
+
+    bool connected() const { return player != 0; }
+
+    bool timed_out() const { return quiet_ticks > NET_TIMEOUT_TICKS; }
+
+    const std::string &map_path() const { return server_map; }
+
+    // Movement, jumps and edits for the command of the current tick
+    void input(const Input &input);
+
+    // Rewind to the last server state and run the unacknowledged commands
+    // again. Call before stepping the Thing for this tick.
+    void predict(Thing &thing, Map &map);
+
+    // Close the command of this tick and send it with the recent ones
+    void send(const Camera &view);
+
+    // Other players as of the latest snapshot, by player id
+    const std::vector<std::pair<uint16_t, ThingState>> &players() const { return others; }
+
+    const Socket &traffic() const { return socket; }
+
+    size_t snapshots = 0;
+    // Predictions off by more than a five thousandth of a tile
+    size_t corrections = 0;
+
+private:
+    struct Received {
+        uint32_t id = 0;
+        // Sorted by player id
+        std::vector<std::pair<uint16_t, ThingState>> things;
+    };
+
+    static constexpr size_t RECEIVED_HISTORY = 32;
+
+    void handle_welcome(ByteReader &packet);
+
+    void handle_snapshot(ByteReader &packet, Map &map);
+
+    void send_connect();
+
+    Socket socket;
+    NetAddress server;
+    uint16_t player = 0;
+    // The server's materials differ, its welcomes are ignored
+    bool refused = false;
+    std::string server_map;
+    uint32_t quiet_ticks = 0;
+
+    Command current;
+    std::deque<Command> history;
+    uint32_t next_seq = 1;
+
+    std::array<Received, RECEIVED_HISTORY> received;
+    uint32_t latest = 0;
+    std::vector<std::pair<uint16_t, ThingState>> others;
+
+    bool fresh = false;
+    ThingState server_state{};
+    uint32_t processed_seq = 0;
+};
@@ -4,11 +4,26 @@
 #include <SDL2/SDL_rect.h>
 #include <SDL2/SDL_render.h>
 
+#include "world.hpp"
+
+// Box in Q24 fixed point tiles, collision math stays in integers
+struct FixedRect {
+    int64_t x = 0;
+    int64_t y = 0;
+    int64_t w = 0;
+    int64_t h = 0;
+
+    static FixedRect tile(int64_t column, int64_t row)
+    {
+        return { column * FIXED_ONE, row * FIXED_ONE, FIXED_ONE, FIXED_ONE };
+    }
+};
+
 struct Collider {
-    Collider(SDL_FRect rect = {}, bool active = true)
+    Collider(FixedRect rect = {}, bool active = true)
         : rect(rect), active(active) {}
 
-    static bool aabb(const SDL_FRect &a, const SDL_FRect &b)
+    static bool aabb(const FixedRect &a, const FixedRect &b)
     {
         return a.x + a.w >= b.x
             && b.x + b.w >= a.x
@@ -16,7 +31,7 @@ struct Collider {
             && b.y + b.h >= a.y;
     }
 
-    bool colliding(const SDL_FRect &other)
+    bool colliding(const FixedRect &other)
     {
         return active && aabb(rect, other);
     }
@@ -26,18 +41,18 @@ struct Collider {
         return active && other.active && aabb(rect, other.rect);
     }
 
-    void render(SDL_Renderer *renderer, const SDL_FRect &camera)
+    void render(SDL_Renderer *renderer, const Camera &camera, float scale)
     {
         SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
         SDL_FRect dst = {
-            .x = rect.x - camera.x,
-            .y = rect.y - camera.y,
-            .w = rect.w,
-            .h = rect.h,
+            .x = to_tiles(rect.x - camera.pos.x.fixed()) * scale,
+            .y = to_tiles(rect.y - camera.pos.y.fixed()) * scale,
+            .w = to_tiles(rect.w) * scale,
+            .h = to_tiles(rect.h) * scale,
         };
         SDL_RenderDrawRectF(renderer, &dst);
     }
 
-    SDL_FRect rect;
+    FixedRect rect;
     bool active;
 };
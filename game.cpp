@@ -5,6 +5,7 @@
 
 #include "game.hpp"
 #include "map.hpp"
+#include "profile.hpp"
 #include "thing.hpp"
 #include "vec2.hpp"
 #include "util.hpp"
@@ -13,31 +14,74 @@
 #include "imgui_impl_sdl2.h"
 #include "imgui_impl_sdlrenderer2.h"
 
-Game::Game(int width, int height, SDL_Renderer *renderer) :  window_width(width), window_height(height), rand_generator(rand_device()), renderer(renderer)
+Game::Game(int width, int height, SDL_Renderer *renderer, uint32_t seed, const std::string &map_path) :  window_width(width), window_height(height), rand_generator(seed), renderer(renderer)
 {
-    constexpr int SCALE = 16 * 2;
-    tile_size = width / SCALE;
+    camera = {};
+    resize(width, height);
 
-    camera = {
-        .x = 0,
-        .y = 0,
-        .w = float(16 * 2 * tile_size),
-        .h = float(9 * 2 * tile_size),
-    };
+    map.init(renderer);
+    thing.init(renderer, 1.0f);
+    remote.init(renderer, 1.0f);
 
-    map.init(renderer, tile_size);
+    if (renderer != nullptr) {
+        lod.init(renderer, material_table.texture.data(), map.generated());
+        particles.init();
+        workers = std::make_unique<WorkerPool>();
+    }
 
-    if (!map.load_file("maps/test.map")) {
+    if (!load_map(map_path)) {
         std::cout << "Failed to load map" << std::endl;
         panic();
     }
+}
+
+bool Game::load_map(const std::string &path)
+{
+    if (!map.load_file(path))
+        return false;
 
-    thing.init(renderer, tile_size);
+    hit_count = 0;
+    last_autosave = ticks;
+    move_dir = 0.0f;
+    particles.clear();
     thing.spawn(map.spawn());
+    lod.reset(map.width(), map.height());
+    set_zoom(zoom);
+    return true;
+}
+
+void Game::resize(int width, int height)
+{
+    if (width <= 0 || height <= 0) return;
+
+    // Always as many tiles across, the height follows the aspect ratio
+    window_width = width;
+    window_height = height;
+    view_width = VIEW_TILES;
+    view_height = VIEW_TILES * height / width;
+    set_zoom(zoom);
 }
 
+void Game::set_zoom(float zoom)
+{
+    // Never zoom out past the point where the whole map is visible
+    float max_zoom = std::max({
+        1.0f,
+        map.width() / view_width,
+        map.height() / view_height,
+    });
+
+    this->zoom = std::clamp(zoom, 1.0f, max_zoom);
+    camera.w = view_width * this->zoom;
+    camera.h = view_height * this->zoom;
+}
+
+constexpr float ZOOM_STEP = 1.25f;
+
 void Game::events()
 {
+    PROFILE_ZONE("Game::events");
+
     SDL_Event event;
     while (SDL_PollEvent(&event))
     {
@@ -49,139 +93,843 @@ void Game::events()
                 is_running = false;
                 break;
 
+            case SDL_WINDOWEVENT:
+                if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                    resize(event.window.data1, event.window.data2);
+                break;
+
             case SDL_KEYDOWN:
+                if (event.key.keysym.sym == SDLK_F9) {
+                    constexpr float TRACE_SECONDS = 5.0f;
+                    if (profile::dump_chrome_trace("trace.json", TRACE_SECONDS))
+                        std::cout << "Wrote trace.json" << std::endl;
+                    else
+                        std::cout << "Failed to write trace.json" << std::endl;
+                    break;
+                }
+
+                if (event.key.keysym.sym == SDLK_F12) {
+                    frame_capture().screenshot("screenshot_" + std::to_string(SDL_GetTicks()) + ".png");
+                    break;
+                }
+
+                if (event.key.keysym.sym == SDLK_F10) {
+                    if (capturing())
+                        screen->stop();
+                    else
+                        start_capture(screen_path);
+                    break;
+                }
+
+                if (event.key.keysym.sym == SDLK_F5) {
+                    save("quicksave.snap");
+                    break;
+                }
+
+                if (event.key.keysym.sym == SDLK_F6) {
+                    if (can_load())
+                        load("quicksave.snap");
+                    break;
+                }
+
+                // Typing into a text field is not game input
+                if (!input_enabled || ImGui::GetIO().WantCaptureKeyboard) break;
+
                 switch (event.key.keysym.sym)
                 {
+                    // Applied by sample_input at the step they happened in,
+                    // auto repeat would only jump again
                     case SDLK_a:
-                        thing.move_input(-1.0f);
+                    case SDLK_d:
+                    case SDLK_SPACE:
+                        if (!event.key.repeat)
+                            key_edges.push_back({ event.key.timestamp, event.key.keysym.sym, true });
                         break;
 
-                    case SDLK_d:
-                        thing.move_input(1.0f);
+                    case SDLK_EQUALS:
+                        set_zoom(zoom / ZOOM_STEP);
                         break;
 
-                    case SDLK_SPACE:
-                        thing.jump();
+                    case SDLK_MINUS:
+                        set_zoom(zoom * ZOOM_STEP);
+                        break;
+
+                    default:
+                        // Number keys pick the brush material
+                        if (event.key.keysym.sym >= SDLK_1 && event.key.keysym.sym < SDLK_1 + int(M_COUNT) - 1)
+                            brush = Material(M_DIRT + event.key.keysym.sym - SDLK_1);
                         break;
                 }
                 break;
 
             case SDL_KEYUP:
+                if (!input_enabled) break;
+
                 switch (event.key.keysym.sym)
                 {
                     case SDLK_a:
                     case SDLK_d:
-                        thing.stop_input();
+                        key_edges.push_back({ event.key.timestamp, event.key.keysym.sym, false });
                         break;
                 }
                 break;
 
+            case SDL_MOUSEWHEEL:
+                if (ImGui::GetIO().WantCaptureMouse) break;
+
+                set_zoom(zoom * std::pow(ZOOM_STEP, -event.wheel.y));
+                break;
+
+            case SDL_MOUSEBUTTONDOWN:
+                if (!input_enabled || ImGui::GetIO().WantCaptureMouse) break;
+
+                if (event.button.button == SDL_BUTTON_LEFT)
+                    edit_at(event.button.x, event.button.y, M_VOID);
+                else if (event.button.button == SDL_BUTTON_RIGHT)
+                    edit_at(event.button.x, event.button.y, brush);
+                break;
+
+            case SDL_MOUSEMOTION:
+                if (!input_enabled || ImGui::GetIO().WantCaptureMouse) break;
+
+                if (event.motion.state & SDL_BUTTON_LMASK)
+                    edit_at(event.motion.x, event.motion.y, M_VOID);
+                else if (event.motion.state & SDL_BUTTON_RMASK)
+                    edit_at(event.motion.x, event.motion.y, brush);
+                break;
+
             default:
                 break;
         }
     }
+
 }
 
-void Game::update(float delta)
+void Game::sample_input(uint32_t step_end_ms)
 {
-    thing.update(delta);
+    if (!input_enabled || renderer == nullptr) {
+        key_edges.clear();
+        return;
+    }
 
-    Tile *tiles[8];
-    auto colliding = map.colliding(thing.collider, tiles);
+    // Edges up to the end of this step, in the order they happened
+    size_t applied = 0;
+    for (; applied < key_edges.size() && key_edges[applied].timestamp <= step_end_ms; applied++) {
+        auto &edge = key_edges[applied];
+        if (edge.key == SDLK_SPACE)
+            apply({ .tick = ticks, .kind = I_JUMP });
+        else
+            (edge.key == SDLK_a ? held_left : held_right) = edge.down;
+
+        set_move(float(held_right) - float(held_left));
+        if (measure_latency)
+            latency_pending.push_back(edge.timestamp);
+    }
+    key_edges.erase(key_edges.begin(), key_edges.begin() + applied);
+
+    // Once the edges of this frame are in, the keyboard as run_frame last
+    // sampled it decides, a release still in the queue already counts
+    if (key_edges.empty()) {
+        held_left = keyboard_left;
+        held_right = keyboard_right;
+        set_move(float(held_right) - float(held_left));
+    }
+}
 
-    if (show_colliders) {
-        hits.clear();
-        hits.insert(hits.end(), colliding.begin(), colliding.end());
+void Game::set_move(float dir)
+{
+    if (dir == move_dir) return;
+
+    move_dir = dir;
+    if (dir == 0.0f)
+        apply({ .tick = ticks, .kind = I_STOP });
+    else
+        apply({ .tick = ticks, .kind = I_MOVE, .dir = dir });
+}
+
+void Game::edit_at(int x, int y, Material material)
+{
+    WorldPos world = {
+        camera.pos.x + to_fixed(x / pixels_per_tile()),
+        camera.pos.y + to_fixed(y / pixels_per_tile()),
+    };
+    if (world.x.fixed() < 0 || world.y.fixed() < 0) return;
+
+    size_t row = world.y.tile();
+    size_t column = world.x.tile();
+
+    // Do not bury the thing or another player inside a solid tile, the
+    // server refuses those edits
+    FixedRect tile = FixedRect::tile(column, row);
+    if (material_solid(material)) {
+        if (thing.collider.colliding(tile))
+            return;
+
+        if (client) {
+            for (auto &[id, state] : client->players()) {
+                remote.restore(state);
+                if (remote.collider.colliding(tile))
+                    return;
+            }
+        }
+    }
+
+    apply({
+        .tick = ticks,
+        .kind = I_EDIT,
+        .row = uint32_t(row),
+        .column = uint32_t(column),
+        .material = material,
+    });
+}
+
+void Game::apply(const Input &input)
+{
+    if (recorder)
+        recorder->write(input);
+
+    if (client)
+        client->input(input);
+
+    switch (input.kind)
+    {
+        case I_MOVE:
+            thing.move_input(input.dir);
+            break;
+
+        case I_STOP:
+            thing.stop_input();
+            break;
+
+        case I_JUMP:
+            thing.jump();
+            break;
+
+        case I_EDIT:
+            map.set_tile(input.row, input.column, input.material);
+            break;
+
+        case I_STRESS:
+            // Random edits would only diverge from the server
+            stress = input.on && !client;
+            break;
+    }
+}
+
+void Game::stress_edits(size_t count)
+{
+    if (map.width() == 0 || map.height() == 0) return;
+
+    std::uniform_int_distribution<size_t> rows(0, map.height() - 1);
+    std::uniform_int_distribution<size_t> columns(0, map.width() - 1);
+    std::uniform_int_distribution<int> materials(M_VOID, M_COUNT - 1);
+
+    for (size_t i = 0; i < count; i++)
+        map.set_tile(rows(rand_generator), columns(rand_generator), Material(materials(rand_generator)));
+}
+
+void Game::edit_effects()
+{
+    constexpr size_t DEBRIS_PARTICLES = 24;
+    constexpr size_t SPLASH_PARTICLES = 16;
+    // Tiles around the view still emit, their particles may fly into it
+    constexpr int64_t VIEW_MARGIN = 16;
+
+    WorldPos view_centre = { camera.pos.x + to_fixed(camera.w / 2), camera.pos.y + to_fixed(camera.h / 2) };
+    particles.follow(view_centre);
+
+    // Edits nobody sees, like stress edits or remote players far away,
+    // would only cost time
+    int64_t first_column = camera.pos.x.tile() - VIEW_MARGIN;
+    int64_t first_row = camera.pos.y.tile() - VIEW_MARGIN;
+    int64_t last_column = (camera.pos.x + to_fixed(camera.w)).tile() + VIEW_MARGIN;
+    int64_t last_row = (camera.pos.y + to_fixed(camera.h)).tile() + VIEW_MARGIN;
+
+    for (auto &change : map.tile_changes()) {
+        if (change.column < first_column || change.column > last_column || change.row < first_row || change.row > last_row)
+            continue;
+
+        WorldPos top = WorldPos::tile(change.column, change.row);
+        top.x += FIXED_ONE / 2;
+        WorldPos centre = { top.x, top.y + FIXED_ONE / 2 };
+
+        // Debris placed inside a solid tile would only die there
+        if (change.before != M_VOID && !material_solid(change.after))
+            particles.emit(centre, material_table.color[change.before], DEBRIS_PARTICLES, 0.006f, 900.0f);
+
+        if (change.after == M_WATER && change.before != M_WATER)
+            particles.emit(top, material_table.color[M_WATER], SPLASH_PARTICLES, 0.005f, 600.0f);
     }
+    map.clear_tile_changes();
+}
 
+void Game::landing_effects()
+{
+    // Standing lands every tick at a crawl, only falls count
+    constexpr float SPLASH_SPEED = 0.006f;
+    constexpr float HARDEST_LANDING = 0.02f;
+    constexpr size_t LANDING_PARTICLES = 96;
+    constexpr SDL_Color SLIME = { 110, 200, 90, 220 };
+
+    float impact = thing.impact;
+    thing.impact = 0.0f;
+    if (impact < SPLASH_SPEED) return;
+
+    // Water splashes, anything else gets slime on it
+    WorldPos feet = thing.centre();
+    feet.y += to_fixed(thing.size * 0.5f);
+    size_t row = feet.y.tile(), column = feet.x.tile();
+    bool water = row < map.height() && column < map.width() && map.tile(row, column) == M_WATER;
+
+    size_t amount = LANDING_PARTICLES * std::min(1.0f, impact / HARDEST_LANDING);
+    particles.emit(feet, water ? material_table.color[M_WATER] : SLIME, amount, impact * 0.5f, 700.0f);
+}
+
+Slice<Tile> step_thing(Thing &thing, Map &map, float delta, Tile (&tiles)[8])
+{
+    thing.update(delta);
+
+    auto colliding = map.colliding(thing.collider, tiles);
     thing.collisions(colliding);
 
-    const size_t map_width = map.width();
-    const size_t map_height = map.height();
+    const int64_t map_width = int64_t(map.width()) << FIXED_BITS;
+    const int64_t map_height = int64_t(map.height()) << FIXED_BITS;
+    const int64_t size = to_fixed(thing.size);
 
     // Clamp to world width
-    if ((thing.pos.x + thing.size) > map_width * tile_size) {
-        thing.pos.x = map_width * tile_size - thing.size;
+    if (thing.pos.x.fixed() + size > map_width) {
+        thing.pos.x = WorldCoord::at(map_width - size);
         thing.vel.x = 0;
-    } else if (thing.pos.x < 0) {
-        thing.pos.x = 0;
+    } else if (thing.pos.x.fixed() < 0) {
+        thing.pos.x = {};
         thing.vel.x = 0;
     }
 
     // Clamp to world height
-    if ((thing.pos.y + thing.size) > map_height * tile_size) {
-        thing.pos.y = map_height * tile_size - thing.size;
+    if (thing.pos.y.fixed() + size > map_height) {
+        thing.pos.y = WorldCoord::at(map_height - size);
         thing.vel.y = 0.0f;
-    } else if (thing.pos.y < 0) {
-        thing.pos.y = 0;
+    } else if (thing.pos.y.fixed() < 0) {
+        thing.pos.y = {};
         thing.vel.y = 0;
     }
 
-    // Follow player with camera
-    Vec2<float> target = {
-        std::clamp(
-            (thing.pos.x + thing.size * 0.5f) - (camera.w * 0.5f),
-            0.0f,
-            map_width * tile_size - camera.w
-        ),
-        std::clamp(
-            (thing.pos.y + thing.size * 0.5f) - (camera.h * 0.5f),
-            0.0f,
-            map_height * tile_size - camera.h
-        ),
-    };
+    return colliding;
+}
+
+void Game::update(float delta)
+{
+    PROFILE_ZONE("Game::update");
+
+    if (stress) {
+        constexpr size_t STRESS_EDITS = 10000;
+        auto start = SDL_GetPerformanceCounter();
+        stress_edits(STRESS_EDITS);
+        stress_ms = (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+    }
+
+    if (client) {
+        client->poll(map);
+        client->predict(thing, map);
+
+        if (client->timed_out()) {
+            std::cout << "Lost connection to server" << std::endl;
+            is_running = false;
+        }
+    }
+
+    Tile tiles[8];
+    auto colliding = step_thing(thing, map, delta, tiles);
+    edit_effects();
+    landing_effects();
+
+    if (show_colliders) {
+        std::copy(colliding.begin(), colliding.end(), hits);
+        hit_count = colliding.len;
+    }
 
     constexpr float SMOOTH_SPEED = 0.1f;
     float alpha = 1.0f - std::exp(-SMOOTH_SPEED * delta);
-    camera.x += (target.x - camera.x) * alpha;
-    camera.y += (target.y - camera.y) * alpha;
+
+    // Follow player with camera, centre the map once it fits in the view.
+    // Only the step towards the target is a float.
+    auto follow = [alpha](WorldCoord &camera, WorldCoord centre, float view, size_t world) {
+        int64_t extent = to_fixed(view);
+        int64_t limit = int64_t(world) << FIXED_BITS;
+        int64_t target = extent >= limit
+            ? (limit - extent) / 2
+            : std::clamp(centre.fixed() - extent / 2, int64_t(0), limit - extent);
+        camera += to_fixed(to_tiles(target - camera.fixed()) * alpha);
+    };
+
+    WorldPos centre = thing.centre();
+    follow(camera.pos.x, centre.x, camera.w, map.width());
+    follow(camera.pos.y, centre.y, camera.h, map.height());
+
+    if (client)
+        client->send(camera);
+
+    ticks++;
+
+    // Headless runs have no renderer and never autosave
+    constexpr const char *AUTOSAVE_PATH = "autosave.snap";
+    uint32_t autosave_ticks = uint32_t(autosave_seconds * 1000.0f / TICK_MS);
+    if (renderer && autosave_ticks > 0 && ticks - last_autosave >= autosave_ticks) {
+        last_autosave = ticks;
+        save(AUTOSAVE_PATH);
+    }
+}
+
+Snapshot Game::capture() const
+{
+    PROFILE_ZONE("Game::capture");
+
+    Snapshot snapshot = {
+        .map_path = map.file_path(),
+        .map_width = uint32_t(map.width()),
+        .map_height = uint32_t(map.height()),
+        .tick = ticks,
+        .thing = thing.state(),
+        .camera = camera.pos,
+        .zoom = zoom,
+        .stress = stress,
+    };
+    snapshot.rng = rand_generator.state;
+
+    // Only copied here, decoding and diffing is left to the saver thread
+    auto &modified = map.modified_chunks();
+    snapshot.captured.resize(modified.size());
+    for (size_t i = 0; i < modified.size(); i++) {
+        auto &capture = snapshot.captured[i];
+        capture.chunk = uint32_t(modified[i]);
+        map.chunk_packed(modified[i], capture.current, capture.loaded);
+    }
+
+    return snapshot;
 }
 
-void Game::render()
+bool Game::restore(const Snapshot &snapshot)
 {
-    map.render(renderer, camera);
-    thing.render(renderer, camera);
+    PROFILE_ZONE("Game::restore");
 
-    if (show_colliders) {
-        for (auto hit : hits) {
-            hit->collider.render(renderer, camera);
+    // Same map, only the chunks edited on either side need touching
+    bool same_map = snapshot.map_path == map.file_path() && snapshot.map_width == map.width() && snapshot.map_height == map.height();
+    if (!same_map && !load_map(snapshot.map_path))
+        return false;
+
+    if (map.width() != snapshot.map_width || map.height() != snapshot.map_height) {
+        std::cout << "Snapshot does not match map: " << snapshot.map_path << std::endl;
+        return false;
+    }
+
+    // Every delta is checked before the map is touched, a corrupt one
+    // rejects the whole snapshot
+    using ChunkTiles = std::array<Material, CHUNK_SIZE * CHUNK_SIZE>;
+    std::vector<ChunkTiles> tiles(snapshot.chunks.size());
+    for (size_t c = 0; c < snapshot.chunks.size(); c++) {
+        auto &delta = snapshot.chunks[c];
+        if (delta.chunk >= map.chunk_count()) {
+            std::cout << "Snapshot chunk out of range: " << delta.chunk << std::endl;
+            return false;
+        }
+
+        map.chunk_source(delta.chunk, tiles[c].data());
+        for (size_t i = 0; i < delta.tiles.size(); i++) {
+            int material = tiles[c][i] ^ delta.tiles[i];
+            if (material >= M_COUNT) {
+                std::cout << "Invalid material in snapshot chunk " << delta.chunk << std::endl;
+                return false;
+            }
+            tiles[c][i] = Material(material);
         }
-        thing.collider.render(renderer, camera);
     }
 
-    render_menu();
-    SDL_RenderPresent(renderer);
+    if (same_map)
+        map.revert();
+
+    for (size_t c = 0; c < snapshot.chunks.size(); c++)
+        map.set_chunk(snapshot.chunks[c].chunk, tiles[c].data());
+
+    // Captured in this session, the chunks are valid as they are
+    uint8_t decoded[CHUNK_SIZE * CHUNK_SIZE];
+    ChunkTiles captured;
+    for (auto &capture : snapshot.captured) {
+        if (capture.chunk >= map.chunk_count()) continue;
+
+        capture.current.decode(decoded);
+        for (size_t i = 0; i < captured.size(); i++)
+            captured[i] = Material(decoded[i]);
+        map.set_chunk(capture.chunk, captured.data());
+    }
+
+    rand_generator.state = snapshot.rng;
+
+    ticks = snapshot.tick;
+    last_autosave = ticks;
+    stress = snapshot.stress;
+    hit_count = 0;
+    move_dir = 0.0f;
+    particles.clear();
+    map.clear_tile_changes();
+    thing.restore(snapshot.thing);
+    set_zoom(snapshot.zoom);
+    camera.pos = snapshot.camera;
+    return true;
+}
+
+void Game::save(const std::string &path)
+{
+    auto start = SDL_GetPerformanceCounter();
+    Snapshot snapshot = capture();
+    capture_ms = (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+
+    saver.save(path, std::move(snapshot));
+}
+
+bool Game::load(const std::string &path)
+{
+    auto start = SDL_GetPerformanceCounter();
+
+    Snapshot snapshot;
+    if (!load_snapshot(path, snapshot) || !restore(snapshot)) {
+        std::cout << "Failed to load snapshot: " << path << std::endl;
+        return false;
+    }
+
+    load_ms = (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+    std::cout << "Loaded snapshot: " << path << std::endl;
+    return true;
 }
 
-void Game::render_menu()
+FrameCapture &Game::frame_capture()
 {
+    if (!screen)
+        screen = std::make_unique<FrameCapture>();
+    return *screen;
+}
+
+bool Game::start_capture(const std::string &path)
+{
+    if (!frame_capture().start(path, capture_format(path))) return false;
+
+    std::cout << "Recording to " << path << std::endl;
+    return true;
+}
+
+uint64_t Game::state_hash() const
+{
+    uint64_t hash = map.hash();
+    hash = fnv1a(&thing.pos, sizeof(thing.pos), hash);
+    hash = fnv1a(&thing.vel, sizeof(thing.vel), hash);
+    hash = fnv1a(&thing.accel, sizeof(thing.accel), hash);
+    hash = fnv1a(&thing.on_ground, sizeof(thing.on_ground), hash);
+    return fnv1a(&ticks, sizeof(ticks), hash);
+}
+
+void Game::run_frame(const std::function<void()> &simulate)
+{
+    auto start = SDL_GetPerformanceCounter();
+
+    // The platform half of ImGui talks to SDL, the rest is a task
     ImGui_ImplSDLRenderer2_NewFrame();
     ImGui_ImplSDL2_NewFrame();
+
+    // Bands are fixed before the camera is known, empty ones cost nothing
+    WorkerPool *pool = parallel_frame ? workers.get() : nullptr;
+    band_count = pool ? std::min(MAX_CULL_BANDS, pool->threads() + 1) : 1;
+
+    // Particles move as far as the simulation did
+    uint32_t first_tick = ticks;
+
+    // Held keys for sample_input. Only the main thread may pump, so this
+    // is the latest the steps can see, they run right after.
+    SDL_PumpEvents();
+    const Uint8 *keys = SDL_GetKeyboardState(nullptr);
+    bool typing = ImGui::GetIO().WantCaptureKeyboard;
+    keyboard_left = keys[SDL_SCANCODE_A] && !typing;
+    keyboard_right = keys[SDL_SCANCODE_D] && !typing;
+
+    graph.clear();
+    auto physics = graph.add("Physics", [&simulate] { simulate(); });
+    // Chunks built in earlier frames only touch the pages, the main thread
+    // uploads them while physics runs
+    auto lod_upload = graph.add("LOD upload", [this] { upload_lod(); }, {}, true);
+    auto plan = graph.add("Cull plan", [this] { plan_cull(); }, { physics });
+    auto lod_sync = graph.add("LOD sync", [this] { sync_lod(); }, { physics, lod_upload }, true);
+
+    std::vector<TaskGraph::Task> drawn = { lod_sync };
+    for (size_t band = 0; band < band_count; band++)
+        drawn.push_back(graph.add("Cull band", [this, band] { cull_band(band); }, { plan }));
+
+    drawn.push_back(graph.add("Particles", [this, first_tick] {
+        particles.update(map, (ticks - first_tick) * TICK_MS);
+        particles.build(draw_camera, draw_scale);
+    }, { plan }));
+
+    // Overlaps culling and particles. Pinned like everything else that
+    // talks to ImGui, the memory and profiler tabs only read atomics.
+    drawn.push_back(graph.add("Build UI", [this] { build_menu(); }, { lod_sync }, true));
+    graph.add("Submit", [this] { submit(); }, drawn, true);
+
+    graph.run(pool);
+
+    for (auto &change : deferred)
+        change();
+    deferred.clear();
+
+    // Nothing caches per chunk data yet, consumers run before this point
+    map.clear_dirty(D_ALL);
+
+    frame.reset();
+
+    frame_times.add((SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency());
+}
+
+void Game::plan_cull()
+{
+    // Past this zoom single tiles are smaller than their texture
+    constexpr float LOD_TILE_PIXELS = 16.0f;
+
+    draw_camera = camera;
+    draw_scale = pixels_per_tile();
+    draw_lod = lod.active() && draw_scale < LOD_TILE_PIXELS;
+    draw_area = draw_lod ? SDL_Rect{ 0, 0, 0, 0 } : map.visible_area(camera);
+
+    TileDraw *tiles = draw_area.w > 0 ? frame.allocate<TileDraw>(draw_area.w * draw_area.h) : nullptr;
+    int area_end = draw_area.y + draw_area.h;
+
+    // Bands end on chunk rows, no chunk is decoded twice
+    int row = draw_area.y;
+    for (size_t band = 0; band < band_count; band++) {
+        int end = area_end;
+        if (band + 1 < band_count) {
+            end = draw_area.y + int((band + 1) * draw_area.h / band_count);
+            end = std::clamp((end + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE, row, area_end);
+        }
+
+        bands[band] = {
+            .row_begin = row,
+            .row_end = end,
+            .tiles = tiles ? tiles + (row - draw_area.y) * draw_area.w : nullptr,
+            .count = 0,
+        };
+        row = end;
+    }
+}
+
+void Game::cull_band(size_t band)
+{
+    auto &rows = bands[band];
+    if (rows.row_end > rows.row_begin)
+        rows.count = map.cull_rows(draw_camera, draw_scale, draw_area, rows.row_begin, rows.row_end, rows.tiles);
+}
+
+void Game::submit()
+{
+    SDL_SetRenderDrawColor(renderer, 212, 241, 249, 255);
+    SDL_RenderClear(renderer);
+
+    if (draw_lod) {
+        PROFILE_ZONE("LodPyramid::draw");
+
+        lod_level = lod.level_for(draw_scale);
+        lod.draw(renderer, lod_level, draw_camera.tiles(), { 0, 0, draw_camera.w * draw_scale, draw_camera.h * draw_scale });
+    } else {
+        PROFILE_ZONE("Map::draw");
+
+        lod_level = -1;
+        for (auto &band : Slice(bands.data(), band_count))
+            map.draw(renderer, Slice(band.tiles, band.count));
+    }
+
+    particles.draw(renderer);
+    particle_stats = particles.stats();
+
+    thing.render(renderer, draw_camera, draw_scale);
+
+    if (client) {
+        for (auto &[id, state] : client->players()) {
+            remote.restore(state);
+            remote.render(renderer, draw_camera, draw_scale);
+        }
+    }
+
+    if (show_colliders) {
+        for (auto &hit : Slice(hits, hit_count)) {
+            hit.collider.render(renderer, draw_camera, draw_scale);
+        }
+        thing.collider.render(renderer, draw_camera, draw_scale);
+    }
+
+    if (show_minimap)
+        render_minimap();
+
+    ImGui_ImplSDLRenderer2_RenderDrawData(ImGui::GetDrawData(), renderer);
+
+    // Presenting leaves the back buffer undefined, read it back first
+    if (screen) {
+        screen->read(renderer);
+        screen_stats = screen->stats();
+    }
+
+    {
+        PROFILE_ZONE("SDL_RenderPresent");
+        SDL_RenderPresent(renderer);
+    }
+
+    // Inputs simulated this frame are on screen now
+    if (!latency_pending.empty()) {
+        uint32_t now = SDL_GetTicks();
+        for (auto timestamp : latency_pending)
+            input_latency.add(float(now - timestamp));
+        latency_pending.clear();
+    }
+}
+
+void Game::sync_lod()
+{
+    if (!lod.active()) return;
+
+    Material tiles[CHUNK_SIZE * CHUNK_SIZE];
+    for (auto chunk : map.dirty_chunks()) {
+        if (!(map.chunk_dirty(chunk) & D_RENDER)) continue;
+
+        map.chunk_tiles(chunk, tiles);
+        lod.update(chunk / map.chunks_x(), chunk % map.chunks_x(), tiles);
+    }
+    map.clear_dirty(D_RENDER);
+}
+
+void Game::upload_lod()
+{
+    if (!lod.active()) return;
+
+    // Built chunks and coarse pages per frame
+    constexpr int LOD_UPLOAD_BUDGET = 64;
+    lod.upload(LOD_UPLOAD_BUDGET);
+}
+
+void Game::render_minimap()
+{
+    if (!lod.active() || map.width() == 0 || map.height() == 0) return;
+
+    constexpr float MINIMAP_SIZE = 256.0f;
+    constexpr float MINIMAP_MARGIN = 16.0f;
+
+    float fit = std::min(MINIMAP_SIZE / map.width(), MINIMAP_SIZE / map.height());
+    SDL_FRect dst = {
+        .x = MINIMAP_MARGIN,
+        .y = MINIMAP_MARGIN,
+        .w = map.width() * fit,
+        .h = map.height() * fit,
+    };
+    SDL_FRect tiles = { 0, 0, float(map.width()), float(map.height()) };
+
+    lod.draw(renderer, lod.level_wider_than(dst.w), tiles, dst);
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderDrawRectF(renderer, &dst);
+
+    SDL_FRect view = {
+        .x = dst.x + std::max(0.0f, camera.tiles().x) * fit,
+        .y = dst.y + std::max(0.0f, camera.tiles().y) * fit,
+        .w = std::min(camera.w, float(map.width())) * fit,
+        .h = std::min(camera.h, float(map.height())) * fit,
+    };
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_RenderDrawRectF(renderer, &view);
+}
+
+void Game::build_menu()
+{
     ImGui::NewFrame();
 
     if (ImGui::Begin("Debug")) {
         int fps = ImGui::GetIO().Framerate;
         ImGui::Text("FPS: %d", fps);
 
+        ImGui::Checkbox("Parallel frame", &parallel_frame);
+        ImGui::SameLine();
+        ImGui::Text("(%zu workers)", workers ? workers->threads() : size_t(0));
+        ImGui::Text("Frame: p50 %.2f ms, p95 %.2f ms", frame_times.percentile(0.5f), frame_times.percentile(0.95f));
+        ImGui::SameLine();
+        if (ImGui::Button("Reset frame times"))
+            frame_times = FrameStats();
+
         ImGui::BeginTabBar("DebugTabs");
 
         if (ImGui::BeginTabItem("Game")) {
-            ImGui::Text("Camera X: %f", camera.x);
-            ImGui::Text("Camera Y: %f", camera.y);
-            ImGui::Text("Thing Position: %f, %f", thing.pos.x, thing.pos.y);
+            ImGui::Text("Camera: chunk %d + %f, chunk %d + %f", camera.pos.x.chunk, to_tiles(camera.pos.x.offset),
+                        camera.pos.y.chunk, to_tiles(camera.pos.y.offset));
+            ImGui::Text("Thing Position: chunk %d + %f, chunk %d + %f", thing.pos.x.chunk, to_tiles(thing.pos.x.offset),
+                        thing.pos.y.chunk, to_tiles(thing.pos.y.offset));
             ImGui::Text("Thing Velocity: %f, %f", thing.vel.x, thing.vel.y);
             ImGui::Text("Thing Accelleration: %f, %f", thing.accel.x, thing.accel.y);
             ImGui::Text("Thing Grounded: %s", thing.on_ground ? "yes" : "no");
             ImGui::Checkbox("Show Colliders", &show_colliders);
+            ImGui::Checkbox("Show Minimap", &show_minimap);
+
+            float zoom_value = zoom;
+            if (ImGui::SliderFloat("Zoom", &zoom_value, 1.0f, 64.0f, "%.2fx"))
+                deferred.push_back([this, zoom_value] { set_zoom(zoom_value); });
+            ImGui::Text("LOD level: %d of %d", lod_level, lod.levels());
+            ImGui::Text("LOD chunks pending: %zu", lod.pending());
+            ImGui::Text("Particles: %zu live, %zu drawn, %.3f ms", particle_stats.live, particle_stats.drawn, particle_stats.update_ms);
+            ImGui::SameLine();
+            // Fills the pool to see what the budget holds
+            if (ImGui::Button("Burst")) {
+                deferred.push_back([this] {
+                    particles.emit(thing.centre(), material_table.color[M_LAPIS], MAX_PARTICLES, 0.015f, 3000.0f);
+                });
+            }
+
+            ImGui::Spacing();
+            if (ImGui::Checkbox("Measure input latency", &measure_latency))
+                latency_pending.clear();
+            if (measure_latency) {
+                ImGui::Text("Input to present: p50 %.0f ms, p95 %.0f ms, max %.0f ms (%zu inputs)",
+                            input_latency.percentile(0.5f), input_latency.percentile(0.95f),
+                            input_latency.max(), input_latency.count());
+                if (ImGui::Button("Reset latency"))
+                    input_latency = FrameStats();
+            }
+
+            if (client) {
+                ImGui::Spacing();
+                ImGui::Text("Players in view: %zu", client->players().size());
+                ImGui::Text("Snapshots: %zu", client->snapshots);
+                ImGui::Text("Corrections: %zu", client->corrections);
+                ImGui::Text("Received: %zu bytes", client->traffic().bytes_received);
+                ImGui::Text("Sent: %zu bytes", client->traffic().bytes_sent);
+            }
             ImGui::EndTabItem();
         }
 
         if (ImGui::BeginTabItem("Map")) {
             ImGui::Text("Map width: %zu", map.width());
             ImGui::Text("Map height: %zu", map.height());
-            ImGui::Text("Spawn X: %g", map.spawn().x);
-            ImGui::Text("Spawn Y: %g", map.spawn().y);
+            ImGui::Text("Spawn X: %lld", (long long)map.spawn().x.tile());
+            ImGui::Text("Spawn Y: %lld", (long long)map.spawn().y.tile());
             ImGui::Text("File path: %s", map.file_path().c_str());
+            ImGui::Text("Dirty chunks: %zu", map.dirty_chunks().size());
+
+            auto &cache = map.cache_stats();
+            size_t tile_count = std::max<size_t>(1, map.width() * map.height());
+            ImGui::Text("Packed tiles: %zu bytes, %.3f per tile", map.packed_bytes(), double(map.packed_bytes()) / tile_count);
+            ImGui::Text("LOD texels: %zu bytes, %.3f per tile", lod.cpu_bytes(), double(lod.cpu_bytes()) / tile_count);
+            ImGui::Text("Map and LOD: %.3f bytes per tile", double(map.packed_bytes() + lod.cpu_bytes()) / tile_count);
+            ImGui::Text("LOD pages: %zu bytes of textures", lod.page_bytes());
+            ImGui::Text("Chunk cache: %zu hits, %zu misses, %.3f ms decoding", cache.hits, cache.misses, cache.decode_ms);
+
+            ImGui::Spacing();
+            int selected = brush - M_DIRT;
+            if (ImGui::Combo("Brush", &selected, material_table.name.data() + M_DIRT, M_COUNT - M_DIRT))
+                brush = Material(M_DIRT + selected);
+
+            bool stress_on = stress;
+            if (ImGui::Checkbox("Stress edits (10k/tick)", &stress_on) && input_enabled)
+                deferred.push_back([this, stress_on] { apply({ .tick = ticks, .kind = I_STRESS, .on = stress_on }); });
+            if (stress) ImGui::Text("Stress edit time: %.3f ms", stress_ms);
 
             ImGui::Spacing();
             ImGui::Text("Load new map");
@@ -190,23 +938,65 @@ void Game::render_menu()
             ImGui::InputText("##path", map_path, IM_ARRAYSIZE(map_path));
             ImGui::SameLine();
 
-            if (ImGui::Button("Load")) {
-                if (!map.load_file(map_path)) {
-                    std::cout << "Failed to load map: " << map_path << std::endl;
-                    panic();
-                } else {
-                    thing.spawn(map.spawn());
-                    std::cout << "Loaded map: " << map_path << std::endl;
-                }
+            // Like F6, a new map is not an input. Culling may still be
+            // reading the current one, so it is loaded after the frame.
+            if (ImGui::Button("Load") && can_load()) {
+                deferred.push_back([this, path = std::string(map_path)] {
+                    if (!load_map(path)) {
+                        std::cout << "Failed to load map: " << path << std::endl;
+                        panic();
+                    } else {
+                        std::cout << "Loaded map: " << path << std::endl;
+                    }
+                });
             }
 
             ImGui::EndTabItem();
         }
 
+        if (ImGui::BeginTabItem("Save")) {
+            ImGui::Text("F5 quicksave, F6 quickload");
+            ImGui::Text("Modified chunks: %zu", map.modified_chunks().size());
+            ImGui::Text("Capture time: %.3f ms", capture_ms);
+            ImGui::Text("Write time: %.3f ms%s", saver.last_write_ms(), saver.busy() ? " (writing)" : "");
+            ImGui::Text("Last size: %zu bytes", saver.last_size());
+            ImGui::Text("Load time: %.3f ms", load_ms);
+            ImGui::SliderInt("Autosave (s)", &autosave_seconds, 0, 600);
+            ImGui::EndTabItem();
+        }
+
+        if (ImGui::BeginTabItem("Capture")) {
+            ImGui::Text("F12 screenshot, F10 starts or stops recording");
+            ImGui::InputText("##capture", screen_path, IM_ARRAYSIZE(screen_path));
+            ImGui::SameLine();
+            if (ImGui::Button(capturing() ? "Stop" : "Record")) {
+                deferred.push_back([this] {
+                    if (capturing())
+                        screen->stop();
+                    else
+                        start_capture(screen_path);
+                });
+            }
+            ImGui::Text("Format: %s", capture_format(screen_path) == CAPTURE_RAW ? "raw RGBA stream" : "PNG directory");
+            ImGui::Text("Frames: %zu captured, %zu written, %zu dropped", screen_stats.captured, screen_stats.written, screen_stats.dropped);
+            ImGui::Text("Read back: %.3f ms a frame", screen_stats.read_ms);
+            ImGui::Text("Write: %.3f ms a frame, %zu queued", screen_stats.write_ms, screen_stats.queued);
+            ImGui::EndTabItem();
+        }
+
+        if (ImGui::BeginTabItem("Memory")) {
+            memory::render_tab();
+            ImGui::EndTabItem();
+        }
+
+        if (ImGui::BeginTabItem("Profiler")) {
+            profile::render_tab();
+            ImGui::EndTabItem();
+        }
+
         ImGui::EndTabBar();
     }
     ImGui::End();
 
     ImGui::Render();
-    ImGui_ImplSDLRenderer2_RenderDrawData(ImGui::GetDrawData(), renderer);
 }
@@ -2,44 +2,235 @@
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_image.h>
+#include <array>
+#include <functional>
+#include <memory>
 #include <random>
 #include <vector>
 
+#include "capture.hpp"
+#include "client.hpp"
+#include "input.hpp"
+#include "lod.hpp"
 #include "map.hpp"
+#include "particles.hpp"
+#include "replay.hpp"
+#include "snapshot.hpp"
+#include "tasks.hpp"
 #include "thing.hpp"
 
+// Fixed simulation step, keeps runs reproducible from their inputs
+constexpr float TICK_MS = 1000.0f / 120.0f;
+
+// One step of a Thing against the map, shared by the game, the server and
+// client prediction so all of them agree. Returns the tiles it touched.
+Slice<Tile> step_thing(Thing &thing, Map &map, float delta, Tile (&tiles)[8]);
+
+// Tiles across the window at zoom 1, whatever its resolution
+constexpr float VIEW_TILES = 16 * 2;
+
 class Game {
 public:
-    Game(int width, int height, SDL_Renderer *renderer);
+    // A null renderer runs the simulation headless, without textures or ImGui
+    Game(int width, int height, SDL_Renderer *renderer, uint32_t seed, const std::string &map_path = "maps/test.map");
 
     void events();
 
+    void apply(const Input &input);
+
+    // Apply key presses that happened before the wall clock time, in
+    // SDL_GetTicks milliseconds, the next step ends at, then the held keys
+    // as events() last saw them. Call right before every update.
+    void sample_input(uint32_t step_end_ms);
+
     void update(float delta);
 
-    void render();
+    // New window size in pixels, only the view changes, the world is in tiles
+    void resize(int width, int height);
+
+    // Run the steps owed in simulate, then draw. The frame is a task graph:
+    // the steps run on the worker pool while this thread uploads built LOD
+    // chunks. Once they are done, culling bands and particles run on the
+    // pool while this thread syncs the LOD and builds the UI, then submits.
+    void run_frame(const std::function<void()> &simulate);
+
+    bool load_map(const std::string &path);
+
+    // Loading is not an input, it would break recordings, replays and the
+    // server's view of the world
+    bool can_load() const { return input_enabled && !client && !(recorder && recorder->recording()); }
 
     bool running() { return is_running; }
 
+    // Every applied input is also written to the recorder
+    void record(Recorder *recorder) { this->recorder = recorder; }
+
+    // Ignore keyboard and mouse while a replay drives the game
+    void set_input_enabled(bool enabled) { input_enabled = enabled; }
+
+    // Play on a server instead of alone, its map must already be loaded
+    void connect(Client *client) { this->client = client; }
+
+    uint32_t tick() const { return ticks; }
+
+    // Hash of the simulation state, equal runs give equal hashes
+    uint64_t state_hash() const;
+
+    // Copies only chunks edited since the map was loaded
+    Snapshot capture() const;
+
+    bool restore(const Snapshot &snapshot);
+
+    // Captures now, encoding and writing happen on the writer thread
+    void save(const std::string &path);
+
+    bool load(const std::string &path);
+
+    // Record the window into path, a raw stream or a directory of PNGs
+    // depending on its extension, see capture_format
+    bool start_capture(const std::string &path);
+
     void camera_vertical(int tiles);
 
     void camera_horizontal(int tiles);
 
 private:
-    void render_menu();
+    // ImGui widgets and draw lists only, runs on any thread
+    void build_menu();
+
+    // Camera, scale and row bands for the cull tasks
+    void plan_cull();
+
+    void cull_band(size_t band);
+
+    // Everything that talks to the renderer, main thread only
+    void submit();
+
+    // Queue changed chunks for the LOD worker
+    void sync_lod();
+
+    // Upload chunks and pages the LOD worker finished, needs no physics
+    void upload_lod();
+
+    // The window capture, created on first use
+    FrameCapture &frame_capture();
+
+    bool capturing() const { return screen && screen->recording(); }
+
+    void render_minimap();
+
+    // Zoom out factor, 1 shows VIEW_TILES across
+    void set_zoom(float zoom);
+
+    // Converts the camera, in tiles, to the window
+    float pixels_per_tile() const { return window_width / camera.w; }
+
+    // Dig or place at a window position
+    void edit_at(int x, int y, Material material);
+
+    void stress_edits(size_t count);
+
+    // Debris for dug out tiles, a splash for placed water, whoever
+    // changed them: inputs, the server or the stress test
+    void edit_effects();
+
+    // Splash of water or slime when the thing lands hard
+    void landing_effects();
+
+    // Apply a held direction once it changes
+    void set_move(float dir);
 
     int window_width;
     int window_height;
-    int tile_size;
 
     bool is_running = true;
+    bool input_enabled = true;
+    uint32_t ticks = 0;
+    Recorder *recorder = nullptr;
+
+    struct KeyEdge {
+        uint32_t timestamp;
+        SDL_Keycode key;
+        bool down;
+    };
+    std::vector<KeyEdge> key_edges;
+    bool held_left = false;
+    bool held_right = false;
+    // Sampled by run_frame, steps on workers must not call into SDL
+    bool keyboard_left = false;
+    bool keyboard_right = false;
+    float move_dir = 0.0f;
+
+    // Event timestamps of inputs simulated but not yet presented
+    bool measure_latency = false;
+    std::vector<uint32_t> latency_pending;
+    FrameStats input_latency;
+    Client *client = nullptr;
     bool show_colliders = false;
-    std::vector<Tile *> hits;
+    // Tiles touched in the last update, kept for the collider overlay
+    Tile hits[8];
+    size_t hit_count = 0;
+
+    // Scratch memory for the current frame, rewound after presenting
+    Arena frame{MEM_FRAME, 256 << 10};
 
-    std::random_device rand_device;
-    std::mt19937 rand_generator;
+    Material brush = M_DIRT;
+    bool stress = false;
+    float stress_ms = 0.0f;
+
+    SplitMix64 rand_generator;
+
+    SnapshotWriter saver;
+    // Seconds between autosaves, 0 turns them off
+    int autosave_seconds = 60;
+    uint32_t last_autosave = 0;
+    float capture_ms = 0.0f;
+    float load_ms = 0.0f;
+
+    // Frames of the window, read back in submit. Created by the first
+    // screenshot or recording, its writer thread is idle otherwise.
+    std::unique_ptr<FrameCapture> screen;
+    // Copied when submitting like the particle stats
+    CaptureStats screen_stats;
+    char screen_path[128] = "capture.rgba";
 
     Map map;
     Thing thing;
-    SDL_FRect camera;
+    // Drawn once per other player when connected
+    Thing remote;
+    LodPyramid lod;
+    // Only set up with a renderer, headless runs never emit
+    Particles particles;
+    // Copied when submitting, the UI of the next frame shows them
+    ParticleStats particle_stats;
+    // World units are tiles, the camera and view sizes too
+    Camera camera;
+    float view_width;
+    float view_height;
+    float zoom = 1.0f;
+    int lod_level = -1;
+    bool show_minimap = true;
     SDL_Renderer *renderer;
+
+    // Null when headless
+    std::unique_ptr<WorkerPool> workers;
+    TaskGraph graph;
+    bool parallel_frame = true;
+    FrameStats frame_times;
+    // Changes asked for by the UI, applied once the frame's tasks are done
+    std::vector<std::function<void()>> deferred;
+
+    static constexpr size_t MAX_CULL_BANDS = 8;
+    struct CullBand {
+        int row_begin;
+        int row_end;
+        TileDraw *tiles;
+        size_t count;
+    };
+    std::array<CullBand, MAX_CULL_BANDS> bands;
+    size_t band_count = 0;
+    Camera draw_camera;
+    float draw_scale = 1.0f;
+    SDL_Rect draw_area;
+    bool draw_lod = false;
 };
@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+#include "input.hpp"
+
+bool load_script(const std::string &path, InputScript &script)
+{
+    std::ifstream infile(path);
+    if (!infile)
+        return false;
+
+    std::string line;
+    size_t number = 0;
+    while (std::getline(infile, line))
+    {
+        number++;
+        std::istringstream stream(line);
+        std::string word;
+
+        if (!(stream >> word) || word[0] == '#')
+            continue;
+
+        if (word == "map") {
+            stream >> script.map_path;
+        } else if (word == "seed") {
+            stream >> script.seed;
+        } else if (word == "ticks") {
+            stream >> script.ticks;
+        } else {
+            Input input;
+            std::string action;
+
+            std::istringstream tick(word);
+            if (!std::isdigit((unsigned char)word[0]) || !(tick >> input.tick) || !tick.eof()) {
+                std::cout << path << ":" << number << ": Invalid tick " << word << std::endl;
+                return false;
+            }
+            stream >> action;
+
+            if (action == "move") {
+                input.kind = I_MOVE;
+                stream >> input.dir;
+            } else if (action == "stop") {
+                input.kind = I_STOP;
+            } else if (action == "jump") {
+                input.kind = I_JUMP;
+            } else if (action == "edit") {
+                int material;
+                input.kind = I_EDIT;
+                stream >> input.row >> input.column >> material;
+                if (material < M_VOID || material >= M_COUNT)
+                    stream.setstate(std::ios::failbit);
+                input.material = Material(material);
+            } else if (action == "stress") {
+                input.kind = I_STRESS;
+                stream >> input.on;
+            } else {
+                std::cout << path << ":" << number << ": Invalid action " << action << std::endl;
+                return false;
+            }
+
+            script.inputs.push_back(input);
+        }
+
+        if (stream.fail()) {
+            std::cout << path << ":" << number << ": Invalid arguments" << std::endl;
+            return false;
+        }
+    }
+
+    std::stable_sort(script.inputs.begin(), script.inputs.end(), [](const Input &a, const Input &b) {
+        return a.tick < b.tick;
+    });
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "map.hpp"
+
+enum InputKind : uint8_t {
+    I_MOVE,
+    I_STOP,
+    I_JUMP,
+    I_EDIT,
+    I_STRESS,
+};
+
+// A single player action, stamped with the simulation tick it applies to
+struct Input {
+    uint32_t tick = 0;
+    InputKind kind = I_STOP;
+    float dir = 0.0f;
+    uint32_t row = 0;
+    uint32_t column = 0;
+    Material material = M_VOID;
+    bool on = false;
+};
+
+struct InputScript {
+    std::string map_path = "maps/test.map";
+    uint32_t seed = 0;
+    uint32_t ticks = 0;
+    std::vector<Input> inputs;
+};
+
+// Text script driving a headless run, see maps/test.input
+bool load_script(const std::string &path, InputScript &script);
@@ -0,0 +1,487 @@
+#include <SDL2/SDL_image.h>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+#include "lod.hpp"
+#include "profile.hpp"
+
+// Background color behind void tiles, same as Map::draw clears with
+static constexpr uint32_t SKY = 212 | 241 << 8 | 249 << 16 | 255u << 24;
+
+static uint32_t pack(uint32_t r, uint32_t g, uint32_t b)
+{
+    return r | g << 8 | b << 16 | 255u << 24;
+}
+
+static uint32_t channel(uint32_t texel, int shift)
+{
+    return texel >> shift & 0xff;
+}
+
+static uint32_t average(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    uint32_t rgb[3];
+    for (int i = 0; i < 3; i++)
+        rgb[i] = (channel(a, i * 8) + channel(b, i * 8) + channel(c, i * 8) + channel(d, i * 8) + 2) / 4;
+    return pack(rgb[0], rgb[1], rgb[2]);
+}
+
+// Level at which a chunk is down to one texel
+static constexpr int CHUNK_LEVEL = 6;
+static_assert(1 << CHUNK_LEVEL == LodPyramid::CHUNK_TEXELS, "CHUNK_LEVEL follows CHUNK_TEXELS");
+
+// CPU texels count towards the LOD memory tag and the Map tab total
+static void hold(std::atomic<size_t> &total, size_t bytes)
+{
+    memory::reserve(MEM_LOD, bytes);
+    memory::use(MEM_LOD, bytes);
+    total += bytes;
+}
+
+static void release(std::atomic<size_t> &total, size_t bytes)
+{
+    memory::unuse(MEM_LOD, bytes);
+    memory::unreserve(MEM_LOD, bytes);
+    total -= bytes;
+}
+
+static size_t page_size(int width, int height, int px, int py)
+{
+    int w = std::min(LodPyramid::PAGE, width - px * LodPyramid::PAGE);
+    int h = std::min(LodPyramid::PAGE, height - py * LodPyramid::PAGE);
+    return size_t(w) * h * sizeof(uint32_t);
+}
+
+LodPyramid::Texels LodPyramid::sample(const uint8_t *pixels, int width, int height, int pitch)
+{
+    Texels texels;
+    for (int ty = 0; ty < TEXELS; ty++) {
+        for (int tx = 0; tx < TEXELS; tx++) {
+            int x0 = tx * width / TEXELS, x1 = std::max(x0 + 1, (tx + 1) * width / TEXELS);
+            int y0 = ty * height / TEXELS, y1 = std::max(y0 + 1, (ty + 1) * height / TEXELS);
+            uint32_t sum[3] = {}, count = 0;
+
+            for (int y = y0; y < y1; y++) {
+                const uint8_t *row = pixels + y * pitch;
+                for (int x = x0; x < x1; x++) {
+                    const uint8_t *p = row + x * 4;
+                    for (int c = 0; c < 3; c++)
+                        sum[c] += (p[c] * p[3] + channel(SKY, c * 8) * (255 - p[3])) / 255;
+                    count++;
+                }
+            }
+
+            texels[ty * TEXELS + tx] = pack(sum[0] / count, sum[1] / count, sum[2] / count);
+        }
+    }
+    return texels;
+}
+
+void LodPyramid::init(SDL_Renderer *renderer, const char *const texture_paths[M_COUNT],
+                      const std::array<std::vector<RxImage>, M_COUNT> &generated)
+{
+    this->renderer = renderer;
+
+    for (int material = 0; material < M_COUNT; material++)
+    {
+        auto &variants = material_texels[material];
+        variants.clear();
+
+        // Map::draw uses the generated images instead of the texture
+        for (auto &image : generated[material])
+            variants.push_back(sample(image.pixels.data(), image.width, image.height, image.width * 4));
+        if (!variants.empty()) continue;
+
+        Texels sky;
+        sky.fill(SKY);
+        variants.push_back(sky);
+
+        if (*texture_paths[material] == '\0') continue;
+
+        SDL_Surface *loaded = IMG_Load(texture_paths[material]);
+        SDL_Surface *surface = loaded ? SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0) : nullptr;
+        if (loaded) SDL_FreeSurface(loaded);
+        if (surface == nullptr) {
+            std::cout << "Failed to sample " << texture_paths[material] << ": " << SDL_GetError() << std::endl;
+            continue;
+        }
+
+        SDL_LockSurface(surface);
+        variants[0] = sample(static_cast<const uint8_t *>(surface->pixels), surface->w, surface->h, surface->pitch);
+        SDL_UnlockSurface(surface);
+        SDL_FreeSurface(surface);
+    }
+
+    worker = std::thread(&LodPyramid::run, this);
+}
+
+void LodPyramid::stop()
+{
+    if (!worker.joinable()) return;
+
+    {
+        std::lock_guard lock(jobs_mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    drained.notify_one();
+    worker.join();
+
+    for (auto &chunk : built)
+        release(texel_bytes, chunk.texels.size() * sizeof(uint32_t));
+    built.clear();
+    destroy_pages();
+}
+
+void LodPyramid::destroy_pages()
+{
+    for (auto &level : pyramid) {
+        for (size_t i = 0; i < level.pages.size(); i++) {
+            if (level.pages[i] == nullptr) continue;
+
+            SDL_DestroyTexture(level.pages[i]);
+            texture_bytes -= page_size(level.width, level.height, i % level.pages_x, i / level.pages_x);
+        }
+        release(texel_bytes, level.texels.size() * sizeof(uint32_t));
+    }
+    pyramid.clear();
+}
+
+void LodPyramid::reset(size_t width, size_t height)
+{
+    if (!active()) return;
+
+    {
+        std::scoped_lock lock(jobs_mutex, levels_mutex);
+        jobs.clear();
+        for (auto &chunk : built)
+            release(texel_bytes, chunk.texels.size() * sizeof(uint32_t));
+        built.clear();
+        generation++;
+        pending_count = building;
+        chunk_columns = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        slots.assign(chunk_columns * ((height + CHUNK_SIZE - 1) / CHUNK_SIZE), -1);
+
+        destroy_pages();
+
+        int level_width = width * TEXELS;
+        int level_height = height * TEXELS;
+        while (level_width > 0 && level_height > 0)
+        {
+            Level level;
+            level.width = level_width;
+            level.height = level_height;
+            level.pages_x = (level_width + PAGE - 1) / PAGE;
+            level.pages_y = (level_height + PAGE - 1) / PAGE;
+            level.pages.assign(level.pages_x * level.pages_y, nullptr);
+            level.dirty.assign(level.pages.size(), 0);
+            pyramid.push_back(std::move(level));
+
+            if (level_width == 1 && level_height == 1) break;
+            level_width = (level_width + 1) / 2;
+            level_height = (level_height + 1) / 2;
+        }
+
+        // From the level where a chunk is one texel up, texels are
+        // downsampled across chunks and have to stay around
+        kept = std::max(0, std::min(CHUNK_LEVEL, levels() - 1));
+        for (int l = kept; l < levels(); l++) {
+            auto &level = pyramid[l];
+            level.texels.assign(size_t(level.width) * level.height, SKY);
+            level.dirty.assign(level.pages.size(), 1);
+            hold(texel_bytes, level.texels.size() * sizeof(uint32_t));
+        }
+    }
+    drained.notify_one();
+}
+
+void LodPyramid::update(size_t chunk_row, size_t chunk_column, const Material *tiles)
+{
+    if (!active()) return;
+
+    {
+        std::lock_guard lock(jobs_mutex);
+        size_t chunk = chunk_row * chunk_columns + chunk_column;
+        if (chunk >= slots.size()) return;
+
+        // A chunk queued twice only keeps its newest tiles
+        if (slots[chunk] < 0) {
+            slots[chunk] = jobs.size();
+            jobs.push_back({ chunk_row, chunk_column, generation, {} });
+        }
+        std::copy(tiles, tiles + CHUNK_SIZE * CHUNK_SIZE, jobs[slots[chunk]].tiles.begin());
+        pending_count = jobs.size() + building + built.size();
+    }
+    wake.notify_one();
+}
+
+void LodPyramid::run()
+{
+    std::vector<Job> batch;
+
+    while (true)
+    {
+        {
+            std::unique_lock lock(jobs_mutex);
+            wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping) return;
+
+            batch.swap(jobs);
+            for (auto &job : batch)
+                slots[job.chunk_row * chunk_columns + job.chunk_column] = -1;
+            building = batch.size();
+        }
+
+        for (auto &job : batch) {
+            {
+                // Built chunks are most of the memory, let the uploads catch up
+                std::unique_lock lock(jobs_mutex);
+                drained.wait(lock, [this] { return stopping || built.size() < MAX_READY; });
+                if (stopping) return;
+            }
+
+            {
+                PROFILE_ZONE("LodPyramid::build");
+                build(job);
+            }
+
+            std::lock_guard lock(jobs_mutex);
+            building--;
+            pending_count = jobs.size() + building + built.size();
+        }
+        batch.clear();
+    }
+}
+
+void LodPyramid::build(const Job &job)
+{
+    Built chunk = { job.chunk_row, job.chunk_column, job.generation, {} };
+
+    {
+        std::lock_guard lock(levels_mutex);
+        if (pyramid.empty() || job.generation != generation) return;
+
+        auto &base = pyramid[0];
+        int x0 = job.chunk_column * CHUNK_TEXELS;
+        int y0 = job.chunk_row * CHUNK_TEXELS;
+        if (x0 >= base.width || y0 >= base.height) return;
+
+        // Levels 0 to kept of this chunk alone, chunks are aligned at
+        // every one of them so this matches downsampling the whole map
+        int w = std::min(CHUNK_TEXELS, base.width - x0);
+        int h = std::min(CHUNK_TEXELS, base.height - y0);
+        size_t total = 0;
+        for (int l = 0, lw = w, lh = h; l <= kept; l++, lw = (lw + 1) / 2, lh = (lh + 1) / 2)
+            total += size_t(lw) * lh;
+        chunk.texels.resize(total);
+
+        uint32_t *texels = chunk.texels.data();
+        for (int y = 0; y < h; y++) {
+            int tile_row = y / TEXELS;
+            for (int x = 0; x < w; x++) {
+                int tile_column = x / TEXELS;
+                auto &variants = material_texels[job.tiles[tile_row * CHUNK_SIZE + tile_column]];
+                uint8_t variant = tile_variant((y0 + y) / TEXELS, (x0 + x) / TEXELS);
+                texels[y * w + x] = variants[variant % variants.size()][(y % TEXELS) * TEXELS + x % TEXELS];
+            }
+        }
+
+        for (int l = 1; l <= kept; l++) {
+            int sw = w, sh = h;
+            const uint32_t *src = texels;
+            texels += size_t(sw) * sh;
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+
+            for (int y = 0; y < h; y++) {
+                int sy0 = y * 2, sy1 = std::min(sh - 1, sy0 + 1);
+                for (int x = 0; x < w; x++) {
+                    int sx0 = x * 2, sx1 = std::min(sw - 1, sx0 + 1);
+                    texels[y * w + x] = average(src[sy0 * sw + sx0], src[sy0 * sw + sx1], src[sy1 * sw + sx0], src[sy1 * sw + sx1]);
+                }
+            }
+        }
+
+        // The kept level takes the coarsest rect, the levels above it
+        // are downsampled across chunks as before
+        auto &level = pyramid[kept];
+        x0 >>= kept;
+        y0 >>= kept;
+        int x1 = x0 + w, y1 = y0 + h;
+        for (int y = 0; y < h; y++)
+            std::copy(texels + y * w, texels + (y + 1) * w, &level.texels[size_t(y0 + y) * level.width + x0]);
+        mark_pages(level, x0, y0, x1, y1);
+
+        for (int l = kept + 1; l < levels(); l++) {
+            x0 /= 2;
+            y0 /= 2;
+            x1 = std::min(pyramid[l].width, (x1 + 1) / 2);
+            y1 = std::min(pyramid[l].height, (y1 + 1) / 2);
+            downsample(l, x0, y0, x1, y1);
+        }
+
+        chunk.texels.resize(texels - chunk.texels.data());
+    }
+
+    if (chunk.texels.empty()) return;
+
+    std::lock_guard lock(jobs_mutex);
+    if (chunk.generation != generation) return;
+
+    hold(texel_bytes, chunk.texels.size() * sizeof(uint32_t));
+    built.push_back(std::move(chunk));
+}
+
+void LodPyramid::downsample(int level, int x0, int y0, int x1, int y1)
+{
+    auto &src = pyramid[level - 1];
+    auto &dst = pyramid[level];
+
+    for (int y = y0; y < y1; y++) {
+        int sy0 = y * 2, sy1 = std::min(src.height - 1, sy0 + 1);
+        for (int x = x0; x < x1; x++) {
+            int sx0 = x * 2, sx1 = std::min(src.width - 1, sx0 + 1);
+            dst.texels[size_t(y) * dst.width + x] = average(
+                src.texels[size_t(sy0) * src.width + sx0], src.texels[size_t(sy0) * src.width + sx1],
+                src.texels[size_t(sy1) * src.width + sx0], src.texels[size_t(sy1) * src.width + sx1]);
+        }
+    }
+
+    mark_pages(dst, x0, y0, x1, y1);
+}
+
+void LodPyramid::mark_pages(Level &level, int x0, int y0, int x1, int y1)
+{
+    for (int py = y0 / PAGE; py <= (y1 - 1) / PAGE; py++)
+        for (int px = x0 / PAGE; px <= (x1 - 1) / PAGE; px++)
+            level.dirty[py * level.pages_x + px] = 1;
+}
+
+SDL_Texture *LodPyramid::page(Level &level, int px, int py)
+{
+    auto &page = level.pages[py * level.pages_x + px];
+    if (page != nullptr) return page;
+
+    int w = std::min(PAGE, level.width - px * PAGE);
+    int h = std::min(PAGE, level.height - py * PAGE);
+    page = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, w, h);
+    if (page == nullptr) panic(SDL_GetError());
+
+    // Chunks not built yet show as sky
+    std::vector<uint32_t> sky(size_t(w) * h, SKY);
+    SDL_UpdateTexture(page, nullptr, sky.data(), w * sizeof(uint32_t));
+    texture_bytes += page_size(level.width, level.height, px, py);
+    return page;
+}
+
+void LodPyramid::upload_chunk(const Built &chunk)
+{
+    int x0 = chunk.chunk_column * CHUNK_TEXELS;
+    int y0 = chunk.chunk_row * CHUNK_TEXELS;
+    int w = std::min(CHUNK_TEXELS, pyramid[0].width - x0);
+    int h = std::min(CHUNK_TEXELS, pyramid[0].height - y0);
+
+    const uint32_t *texels = chunk.texels.data();
+    for (int l = 0; l < kept; l++) {
+        int x = x0 >> l, y = y0 >> l;
+        SDL_Rect rect = { x % PAGE, y % PAGE, w, h };
+        SDL_UpdateTexture(page(pyramid[l], x / PAGE, y / PAGE), &rect, texels, w * sizeof(uint32_t));
+
+        texels += size_t(w) * h;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+}
+
+void LodPyramid::upload(int budget)
+{
+    PROFILE_ZONE("LodPyramid::upload");
+
+    std::vector<Built> batch;
+    {
+        std::lock_guard lock(jobs_mutex);
+        size_t count = std::min(built.size(), size_t(std::max(0, budget)));
+        batch.assign(std::make_move_iterator(built.begin()), std::make_move_iterator(built.begin() + count));
+        built.erase(built.begin(), built.begin() + count);
+        pending_count = jobs.size() + building + built.size();
+    }
+    if (!batch.empty())
+        drained.notify_one();
+    budget -= batch.size();
+
+    std::lock_guard lock(levels_mutex);
+
+    for (auto &chunk : batch) {
+        if (chunk.generation == generation)
+            upload_chunk(chunk);
+        release(texel_bytes, chunk.texels.size() * sizeof(uint32_t));
+    }
+
+    // Coarse levels first, they are cheap and used by the minimap
+    for (int l = pyramid.size() - 1; l >= kept && budget > 0; l--) {
+        auto &level = pyramid[l];
+        for (size_t i = 0; i < level.pages.size() && budget > 0; i++) {
+            if (!level.dirty[i]) continue;
+
+            int px = i % level.pages_x, py = i / level.pages_x;
+            const uint32_t *texels = &level.texels[size_t(py) * PAGE * level.width + px * PAGE];
+            SDL_UpdateTexture(page(level, px, py), nullptr, texels, level.width * sizeof(uint32_t));
+            level.dirty[i] = 0;
+            budget--;
+        }
+    }
+}
+
+int LodPyramid::level_for(float tile_pixels) const
+{
+    // Texels per screen pixel at level 0
+    float density = TEXELS / tile_pixels;
+    int level = density <= 1.0f ? 0 : int(std::ceil(std::log2(density)));
+    return std::clamp(level, 0, std::max(0, levels() - 1));
+}
+
+int LodPyramid::level_wider_than(int min_width) const
+{
+    int level = 0;
+    while (level + 1 < levels() && pyramid[level + 1].width >= min_width)
+        level++;
+    return level;
+}
+
+void LodPyramid::draw(SDL_Renderer *renderer, int level, const SDL_FRect &tiles, const SDL_FRect &dst)
+{
+    if (level < 0 || level >= levels() || tiles.w <= 0 || tiles.h <= 0) return;
+
+    auto &lod = pyramid[level];
+    float texels_per_tile = float(TEXELS) / (1 << level);
+    float sx0 = tiles.x * texels_per_tile, sy0 = tiles.y * texels_per_tile;
+    float sx1 = (tiles.x + tiles.w) * texels_per_tile, sy1 = (tiles.y + tiles.h) * texels_per_tile;
+    float pixels_x = dst.w / (sx1 - sx0), pixels_y = dst.h / (sy1 - sy0);
+
+    int px0 = std::max(0, int(sx0) / PAGE), px1 = std::min(lod.pages_x - 1, int(sx1) / PAGE);
+    int py0 = std::max(0, int(sy0) / PAGE), py1 = std::min(lod.pages_y - 1, int(sy1) / PAGE);
+
+    for (int py = py0; py <= py1; py++) {
+        for (int px = px0; px <= px1; px++) {
+            SDL_Texture *page = lod.pages[py * lod.pages_x + px];
+            if (page == nullptr) continue;
+
+            // Whole texels of this page inside the region
+            int tx0 = std::max(px * PAGE, int(std::floor(sx0)));
+            int ty0 = std::max(py * PAGE, int(std::floor(sy0)));
+            int tx1 = std::min({ (px + 1) * PAGE, lod.width, int(std::ceil(sx1)) });
+            int ty1 = std::min({ (py + 1) * PAGE, lod.height, int(std::ceil(sy1)) });
+            if (tx1 <= tx0 || ty1 <= ty0) continue;
+
+            SDL_Rect src = { tx0 - px * PAGE, ty0 - py * PAGE, tx1 - tx0, ty1 - ty0 };
+            SDL_FRect out = {
+                .x = dst.x + (tx0 - sx0) * pixels_x,
+                .y = dst.y + (ty0 - sy0) * pixels_y,
+                .w = (tx1 - tx0) * pixels_x,
+                .h = (ty1 - ty0) * pixels_y,
+            };
+            SDL_RenderCopyF(renderer, page, &src, &out);
+        }
+    }
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "map.hpp"
+
+// Downsampled images of the whole map, each level half the size of the
+// previous one, drawn from fixed size texture pages so any zoom level
+// costs about one page per screen area. Chunks are rebuilt on a worker
+// thread from snapshots of their tiles. The fine levels, where a chunk
+// still spans several texels, only live in the pages: the worker hands
+// each chunk's texels to the main thread for upload. Only the coarse
+// levels, downsampled across chunks, are kept on the CPU.
+class LodPyramid {
+public:
+    // Texels per tile side at level 0
+    static constexpr int TEXELS = 4;
+    static constexpr int PAGE = 256;
+    // Texels per chunk side at level 0
+    static constexpr int CHUNK_TEXELS = CHUNK_SIZE * TEXELS;
+    // Built chunks waiting for upload before the worker waits
+    static constexpr size_t MAX_READY = 64;
+
+    static_assert(PAGE % CHUNK_TEXELS == 0, "A chunk never straddles pages");
+
+    ~LodPyramid() { stop(); }
+
+    // Sample the material textures, or the images generated for a
+    // material when there are any, and start the worker
+    void init(SDL_Renderer *renderer, const char *const texture_paths[M_COUNT],
+              const std::array<std::vector<RxImage>, M_COUNT> &generated);
+
+    bool active() const { return worker.joinable(); }
+
+    // Drop every level and size them for a new map, main thread only
+    void reset(size_t width, size_t height);
+
+    // Queue a rebuild of a chunk from a copy of its CHUNK_SIZE² tiles
+    void update(size_t chunk_row, size_t chunk_column, const Material *tiles);
+
+    // Upload up to budget built chunks and coarse pages, main thread only
+    void upload(int budget);
+
+    int levels() const { return pyramid.size(); }
+
+    // Finest level whose texels still cover one screen pixel
+    int level_for(float tile_pixels) const;
+
+    // Coarsest level at least min_width texels wide
+    int level_wider_than(int min_width) const;
+
+    // Draw the region given in tiles of a level into dst
+    void draw(SDL_Renderer *renderer, int level, const SDL_FRect &tiles, const SDL_FRect &dst);
+
+    // Chunks queued or built but not uploaded yet
+    size_t pending() const { return pending_count; }
+
+    // Coarse levels and built chunks held on the CPU
+    size_t cpu_bytes() const { return texel_bytes; }
+
+    // Texture pages created so far
+    size_t page_bytes() const { return texture_bytes; }
+
+private:
+    struct Level {
+        int width = 0;
+        int height = 0;
+        int pages_x = 0;
+        int pages_y = 0;
+        // Empty below the first kept level, those only live in pages
+        std::vector<uint32_t> texels;
+        std::vector<SDL_Texture *> pages;
+        std::vector<uint8_t> dirty;
+    };
+
+    struct Job {
+        size_t chunk_row;
+        size_t chunk_column;
+        uint32_t generation;
+        std::array<Material, CHUNK_SIZE * CHUNK_SIZE> tiles;
+    };
+
+    // Texels of a chunk for every level below the first kept one, each
+    // level's rect right after the previous one
+    struct Built {
+        size_t chunk_row;
+        size_t chunk_column;
+        uint32_t generation;
+        std::vector<uint32_t> texels;
+    };
+
+    using Texels = std::array<uint32_t, TEXELS * TEXELS>;
+
+    // Box filter RGBA32 pixels down to TEXELS² blended over the sky
+    static Texels sample(const uint8_t *pixels, int width, int height, int pitch);
+
+    void run();
+
+    void stop();
+
+    void build(const Job &job);
+
+    // Average level - 1 into the given texel rect of level
+    void downsample(int level, int x0, int y0, int x1, int y1);
+
+    void mark_pages(Level &level, int x0, int y0, int x1, int y1);
+
+    // Page of a level, created filled with sky on first use
+    SDL_Texture *page(Level &level, int px, int py);
+
+    void upload_chunk(const Built &built);
+
+    void destroy_pages();
+
+    SDL_Renderer *renderer = nullptr;
+    // One entry per variant, picked by tile_variant like Map::draw does
+    std::array<std::vector<Texels>, M_COUNT> material_texels;
+
+    // Guards jobs, slots, built chunks and stopping
+    std::mutex jobs_mutex;
+    std::condition_variable wake;
+    std::condition_variable drained;
+    std::vector<Job> jobs;
+    std::vector<int32_t> slots;
+    std::vector<Built> built;
+    // Jobs the worker took and has not finished
+    size_t building = 0;
+    size_t chunk_columns = 0;
+    // Bumped by reset, work for an older map is dropped
+    uint32_t generation = 0;
+    bool stopping = false;
+    std::atomic<size_t> pending_count = 0;
+
+    // Guards the level texels and dirty pages
+    std::mutex levels_mutex;
+    std::vector<Level> pyramid;
+    // First level held on the CPU, a chunk is one texel there on big maps
+    int kept = 0;
+
+    std::atomic<size_t> texel_bytes = 0;
+    std::atomic<size_t> texture_bytes = 0;
+
+    std::thread worker;
+};
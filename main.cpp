@@ -2,17 +2,390 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_render.h>
 #include <SDL2/SDL_ttf.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <random>
 
 #include "game.hpp"
+#include "arena.hpp"
+#include "client.hpp"
+#include "input.hpp"
+#include "profile.hpp"
+#include "replay.hpp"
+#include "server.hpp"
 #include "util.hpp"
 
 #include "imgui.h"
 #include "imgui_impl_sdl2.h"
 #include "imgui_impl_sdlrenderer2.h"
 
-int main()
+const int WINDOW_WIDTH = 1600;
+const int WINDOW_HEIGHT = 900;
+
+// Upper bound on simulation time caught up in a single frame
+const float MAX_FRAME_MS = 250.0f;
+
+struct Options {
+    const char *headless = nullptr;
+    const char *record = nullptr;
+    const char *replay = nullptr;
+    const char *server = nullptr;
+    const char *connect = nullptr;
+    const char *soak = nullptr;
+    const char *capture = nullptr;
+};
+
+static bool parse_options(int argc, char *argv[], Options &options)
 {
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 >= argc)
+            return false;
+
+        if (std::strcmp(argv[i], "--headless") == 0)
+            options.headless = argv[++i];
+        else if (std::strcmp(argv[i], "--record") == 0)
+            options.record = argv[++i];
+        else if (std::strcmp(argv[i], "--replay") == 0)
+            options.replay = argv[++i];
+        else if (std::strcmp(argv[i], "--server") == 0)
+            options.server = argv[++i];
+        else if (std::strcmp(argv[i], "--connect") == 0)
+            options.connect = argv[++i];
+        else if (std::strcmp(argv[i], "--soak") == 0)
+            options.soak = argv[++i];
+        else if (std::strcmp(argv[i], "--capture") == 0)
+            options.capture = argv[++i];
+        else
+            return false;
+    }
+
+    // Replays and recordings are single player
+    if (options.connect && (options.replay || options.record))
+        return false;
+
+    // Only a window has frames to capture
+    if (options.capture && (options.headless || options.server || options.soak))
+        return false;
+
+    return !(options.headless && options.replay);
+}
+
+// Load either a text script or a binary replay, has_hash is set for
+// replays that recorded their final state
+static bool load_session(const char *path, InputScript &script, uint64_t &hash, bool &has_hash)
+{
+    has_hash = false;
+    bool loaded = is_replay(path) ? load_replay(path, script, hash, has_hash) : load_script(path, script);
+    if (!loaded)
+        std::cout << "Failed to load session: " << path << std::endl;
+    return loaded;
+}
+
+static void apply_inputs(Game &game, const InputScript &script, size_t &next)
+{
+    while (next < script.inputs.size() && script.inputs[next].tick <= game.tick())
+        game.apply(script.inputs[next++]);
+}
+
+static void check_hash(Game &game, uint64_t expected)
+{
+    uint64_t hash = game.state_hash();
+    std::cout << "Replay hash: " << std::hex << hash << std::dec
+              << (hash == expected ? " (match)" : " (MISMATCH)") << std::endl;
+}
+
+// Run a scripted or recorded session as fast as possible without video, textures or ImGui
+static int run_headless(const Options &options)
+{
+    InputScript script;
+    uint64_t expected_hash = 0;
+    bool has_hash = false;
+    if (!load_session(options.headless, script, expected_hash, has_hash))
+        return 1;
+
+    if (SDL_Init(SDL_INIT_EVENTS | SDL_INIT_TIMER) != 0)
+    {
+        std::cout << "Unable to initialize SDL2: " << SDL_GetError() << std::endl;
+        panic();
+    }
+
+    Game game(WINDOW_WIDTH, WINDOW_HEIGHT, nullptr, script.seed, script.map_path);
+
+    Recorder recorder;
+    if (options.record) {
+        if (!recorder.open(options.record, script.seed, script.map_path)) {
+            std::cout << "Failed to open recording: " << options.record << std::endl;
+            return 1;
+        }
+        game.record(&recorder);
+    }
+
+    FrameStats stats;
+    const double time_freq = SDL_GetPerformanceFrequency();
+    auto time_start = SDL_GetPerformanceCounter();
+    auto time_last = time_start;
+
+    size_t next = 0;
+    while (game.tick() < script.ticks)
+    {
+        apply_inputs(game, script, next);
+        game.update(TICK_MS);
+
+        auto time_now = SDL_GetPerformanceCounter();
+        stats.add((time_now - time_last) / time_freq * 1000.0);
+        time_last = time_now;
+    }
+
+    double elapsed = (time_last - time_start) / time_freq;
+
+    if (recorder.recording())
+        recorder.close(game.tick(), game.state_hash());
+
+    std::cout << "Headless run:" << std::endl;
+    std::cout << "\tTicks: " << game.tick() << std::endl;
+    std::cout << "\tElapsed: " << elapsed * 1000.0 << " ms" << std::endl;
+    std::cout << "\tTicks per second: " << (elapsed > 0 ? game.tick() / elapsed : 0) << std::endl;
+    std::cout << "\tState hash: " << std::hex << game.state_hash() << std::dec << std::endl;
+    stats.report(std::cout);
+
+    if (has_hash)
+        check_hash(game, expected_hash);
+
+    SDL_Quit();
+    return 0;
+}
+
+// Authoritative server for --connect clients, runs until killed
+static int run_server(const Options &options)
+{
+    int port = std::atoi(options.server);
+    if (port <= 0 || port > 65535) {
+        std::cout << "Invalid port: " << options.server << std::endl;
+        return 1;
+    }
+
+    if (SDL_Init(SDL_INIT_EVENTS | SDL_INIT_TIMER) != 0)
+    {
+        std::cout << "Unable to initialize SDL2: " << SDL_GetError() << std::endl;
+        panic();
+    }
+
+    InputScript defaults;
+    Server server;
+    if (!server.open(port, defaults.map_path, false))
+        return 1;
+
+    std::cout << "Serving " << defaults.map_path << " on port " << server.port() << std::endl;
+
+    constexpr float REPORT_MS = 5000.0f;
+
+    FrameStats stats;
+    const float time_freq = SDL_GetPerformanceFrequency();
+    auto time_last = SDL_GetPerformanceCounter();
+    float accumulator = 0.0f, report = 0.0f;
+    size_t sent = 0, received = 0;
+
+    while (true)
+    {
+        auto time_now = SDL_GetPerformanceCounter();
+        float elapsed_ms = (time_now - time_last) / time_freq * 1000.0f;
+        time_last = time_now;
+
+        accumulator = std::min(accumulator + elapsed_ms, MAX_FRAME_MS);
+        while (accumulator >= TICK_MS)
+        {
+            auto start = SDL_GetPerformanceCounter();
+            server.tick();
+            stats.add((SDL_GetPerformanceCounter() - start) / time_freq * 1000.0f);
+            accumulator -= TICK_MS;
+        }
+
+        report += elapsed_ms;
+        if (report >= REPORT_MS) {
+            auto &traffic = server.traffic();
+            std::cout << "Players: " << server.players()
+                      << ", tick p99: " << stats.percentile(0.99f) << " ms"
+                      << ", out: " << (traffic.bytes_sent - sent) * 1000.0f / report << " B/s"
+                      << ", in: " << (traffic.bytes_received - received) * 1000.0f / report << " B/s" << std::endl;
+
+            sent = traffic.bytes_sent;
+            received = traffic.bytes_received;
+            stats = FrameStats();
+            report = 0.0f;
+        }
+
+        SDL_Delay(1);
+    }
+}
+
+// Server and simulated clients in one process over loopback, as fast as possible
+static int run_soak(const Options &options)
+{
+    int count = std::atoi(options.soak);
+    if (count <= 0) {
+        std::cout << "Invalid client count: " << options.soak << std::endl;
+        return 1;
+    }
+
+    if (SDL_Init(SDL_INIT_EVENTS | SDL_INIT_TIMER) != 0)
+    {
+        std::cout << "Unable to initialize SDL2: " << SDL_GetError() << std::endl;
+        panic();
+    }
+
+    InputScript defaults;
+    Server server;
+    if (!server.open(0, defaults.map_path, true))
+        return 1;
+
+    NetAddress address;
+    parse_address("127.0.0.1:" + std::to_string(server.port()), address);
+
+    struct Bot {
+        Client client;
+        Map map;
+        Thing thing;
+        std::mt19937 rng;
+        bool joined = false;
+    };
+
+    std::vector<std::unique_ptr<Bot>> bots;
+    for (int i = 0; i < count; i++) {
+        auto &bot = bots.emplace_back(std::make_unique<Bot>());
+        bot->rng.seed(i);
+        bot->map.init(nullptr);
+        bot->thing.init(nullptr, 1.0f);
+        if (!bot->client.connect(address))
+            return 1;
+    }
+
+    // Twenty seconds of play, a second for everyone to join
+    constexpr uint32_t SOAK_TICKS = 20 * 120;
+    constexpr uint32_t JOIN_TICKS = 120;
+
+    FrameStats stats;
+    const double time_freq = SDL_GetPerformanceFrequency();
+    size_t joined = 0;
+
+    for (uint32_t tick = 0; tick < SOAK_TICKS + JOIN_TICKS; tick++)
+    {
+        for (auto &bot : bots)
+        {
+            bot->client.poll(bot->map);
+
+            if (!bot->joined) {
+                if (bot->client.connected() && bot->map.load_file(bot->client.map_path())) {
+                    bot->thing.spawn(bot->map.spawn());
+                    bot->joined = true;
+                    joined++;
+                }
+                bot->client.send({});
+                continue;
+            }
+
+            bot->client.predict(bot->thing, bot->map);
+
+            // Wander, hop and dig below now and then
+            std::uniform_int_distribution<int> roll(0, 239);
+            int dice = roll(bot->rng);
+            Input input = { .tick = tick, .kind = I_STOP };
+            if (dice < 4) {
+                input.kind = dice < 2 ? I_MOVE : I_STOP;
+                input.dir = dice == 0 ? -1.0f : 1.0f;
+            } else if (dice < 6) {
+                input.kind = I_JUMP;
+            } else if (dice == 6) {
+                input.kind = I_EDIT;
+                WorldPos feet = bot->thing.centre();
+                input.row = uint32_t((feet.y + to_fixed(bot->thing.size * 0.5f)).tile());
+                input.column = uint32_t(feet.x.tile());
+                input.material = M_VOID;
+            }
+
+            if (dice <= 6) {
+                bot->client.input(input);
+                switch (input.kind)
+                {
+                    case I_MOVE: bot->thing.move_input(input.dir); break;
+                    case I_STOP: bot->thing.stop_input(); break;
+                    case I_JUMP: bot->thing.jump(); break;
+                    case I_EDIT: bot->map.set_tile(input.row, input.column, input.material); break;
+                    default: break;
+                }
+            }
+
+            Tile tiles[8];
+            step_thing(bot->thing, bot->map, TICK_MS, tiles);
+
+            bot->client.send({
+                .pos = { bot->thing.pos.x + to_fixed(-16.0f), bot->thing.pos.y + to_fixed(-9.0f) },
+                .w = 32.0f,
+                .h = 18.0f,
+            });
+        }
+
+        auto start = SDL_GetPerformanceCounter();
+        server.tick();
+        if (tick >= JOIN_TICKS)
+            stats.add((SDL_GetPerformanceCounter() - start) / time_freq * 1000.0);
+    }
+
+    size_t down = 0, up = 0, snapshots = 0, corrections = 0;
+    for (auto &bot : bots) {
+        down += bot->client.traffic().bytes_received;
+        up += bot->client.traffic().bytes_sent;
+        snapshots += bot->client.snapshots;
+        corrections += bot->client.corrections;
+    }
+
+    float seconds = (SOAK_TICKS + JOIN_TICKS) * TICK_MS / 1000.0f;
+    std::cout << "Soak test:" << std::endl;
+    std::cout << "\tClients: " << joined << " of " << count << " joined" << std::endl;
+    std::cout << "\tSimulated: " << seconds << " s" << std::endl;
+    std::cout << "\tSnapshots per client: " << snapshots / std::max<size_t>(1, joined) << std::endl;
+    std::cout << "\tDown per client: " << down / seconds / count << " B/s" << std::endl;
+    std::cout << "\tUp per client: " << up / seconds / count << " B/s" << std::endl;
+    std::cout << "\tPrediction corrections: " << corrections << std::endl;
+    std::cout << "Server tick times:" << std::endl;
+    stats.report(std::cout);
+
+    bots.clear();
+    SDL_Quit();
+    return joined == size_t(count) ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    if (!parse_options(argc, argv, options)) {
+        std::cout << "Usage: " << argv[0] << " [--headless <script|replay>] [--record <file>] [--replay <file>]"
+                  << " [--server <port>] [--connect <host:port>] [--soak <clients>] [--capture <dir|file.rgba>]" << std::endl;
+        return 1;
+    }
+
+    // Before any map is parsed, overrides may change the symbols
+    if (!load_materials("assets/materials.txt"))
+        return 1;
+
+    if (options.headless)
+        return run_headless(options);
+
+    if (options.server)
+        return run_server(options);
+
+    if (options.soak)
+        return run_soak(options);
+
+    InputScript script;
+    uint64_t expected_hash = 0;
+    bool has_hash = false;
+    if (options.replay && !load_session(options.replay, script, expected_hash, has_hash))
+        return 1;
+
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_TIMER) != 0)
     {
         std::cout << "Unable to initialize SDL2: " << SDL_GetError() << std::endl;
@@ -25,9 +398,9 @@ int main()
         panic();
     }
 
-    int width = 1600, height = 900;
+    int width = WINDOW_WIDTH, height = WINDOW_HEIGHT;
 
-    auto window = SDL_CreateWindow("thing", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_SHOWN);
+    auto window = SDL_CreateWindow("thing", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, width, height, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
     if (window == nullptr) {
         std::cout << "Unable to create SDL_Window: " << SDL_GetError() << std::endl;
         panic();
@@ -62,22 +435,100 @@ int main()
     ImGui_ImplSDL2_InitForSDLRenderer(window, renderer);
     ImGui_ImplSDLRenderer2_Init(renderer);
 
-    Game game(width, height, renderer);
+    if (!options.replay) {
+        script.seed = std::random_device{}();
+    }
 
-    const float time_freq = SDL_GetPerformanceFrequency();
-    auto time_last = SDL_GetPerformanceCounter();
+    Client client;
+    if (options.connect) {
+        NetAddress address;
+        if (!parse_address(options.connect, address)) {
+            std::cout << "Invalid address: " << options.connect << std::endl;
+            return 1;
+        }
+
+        constexpr uint32_t CONNECT_TIMEOUT_MS = 3000;
+        if (!client.connect(address) || !client.wait_welcome(CONNECT_TIMEOUT_MS)) {
+            std::cout << "Unable to join " << options.connect << std::endl;
+            return 1;
+        }
+
+        script.map_path = client.map_path();
+    }
 
-    while (game.running())
+    // Closed before the renderer goes, the LOD pages are its textures
     {
-        auto time_now = SDL_GetPerformanceCounter();
-        float elapsed_ms = (time_now - time_last) / time_freq * 1000.0f;
-        time_last = time_now;
+        Game game(width, height, renderer, script.seed, script.map_path);
+
+        Recorder recorder;
+        if (options.record) {
+            if (!recorder.open(options.record, script.seed, script.map_path)) {
+                std::cout << "Failed to open recording: " << options.record << std::endl;
+                panic();
+            }
+            game.record(&recorder);
+        }
+
+        if (options.replay)
+            game.set_input_enabled(false);
+
+        if (options.connect)
+            game.connect(&client);
+
+        if (options.capture && !game.start_capture(options.capture))
+            return 1;
+
+        FrameStats stats;
+        const float time_freq = SDL_GetPerformanceFrequency();
+        auto time_last = SDL_GetPerformanceCounter();
+        float accumulator = 0.0f;
+        size_t next = 0;
+
+        while (game.running())
+        {
+            profile::new_frame();
+            memory::new_frame();
+
+            auto time_now = SDL_GetPerformanceCounter();
+            float elapsed_ms = (time_now - time_last) / time_freq * 1000.0f;
+            time_last = time_now;
+            stats.add(elapsed_ms);
+
+            accumulator = std::min(accumulator + elapsed_ms, MAX_FRAME_MS);
+            game.events();
+
+            // Steps still owed end in the past, each takes the inputs up to its end
+            uint32_t frame_ms = SDL_GetTicks();
+            game.run_frame([&] {
+                while (accumulator >= TICK_MS)
+                {
+                    if (options.replay) {
+                        if (game.tick() >= script.ticks) break;
+                        apply_inputs(game, script, next);
+                    }
+
+                    // Rounded once from float ms, truncating each term drifts a step early
+                    double step_end = double(frame_ms) - accumulator + TICK_MS;
+                    game.sample_input(uint32_t(std::max(0.0, std::round(step_end))));
+                    game.update(TICK_MS);
+                    accumulator -= TICK_MS;
+                }
+            });
+
+            if (options.replay && game.tick() >= script.ticks)
+                break;
+
+            SDL_Delay(0);
+        }
+
+        if (recorder.recording())
+            recorder.close(game.tick(), game.state_hash());
 
-        game.events();
-        game.update(elapsed_ms);
-        game.render();
+        if (options.record || options.replay)
+            stats.report(std::cout);
 
-        SDL_Delay(0);
+        if (has_hash)
+            check_hash(game, expected_hash);
     }
 
     ImGui_ImplSDLRenderer2_Shutdown();
@@ -1,27 +1,56 @@
+#include <algorithm>
+#include <cstring>
 #include <fstream>
+#include <memory>
 #include <regex>
 
 #include "map.hpp"
+#include "profile.hpp"
+#include "rx.hpp"
 #include "texture.hpp"
 
-const char *material_texture_path[M_COUNT] = {
-    /* M_VOID */ "",
-    /* M_DIRT */ "assets/dirt.png",
-    /* M_LAPIS */ "assets/lapis.png",
-    /* M_COAL */ "assets/coal.png",
-    /* M_GRASS */ "assets/grass.png",
-    /* M_WATER */ "assets/water.png",
-    /* M_FLOWER */ "assets/flower.png",
-};
-
-void Map::init(SDL_Renderer *renderer, int tile_size)
+void Map::init(SDL_Renderer *renderer)
 {
-    this->tile_size = tile_size;
+    materials = {};
+    variants = {};
+    variant_images = {};
+
+    // Headless
+    if (renderer == nullptr) return;
 
     for (int i = 0; i < M_COUNT; i++)
     {
-        if (*material_texture_path[i] == '\0') continue;
-        materials[i] = load_texture(renderer, material_texture_path[i]);
+        if (*material_table.texture[i] == '\0') continue;
+        materials[i] = load_texture(renderer, material_table.texture[i]);
+    }
+
+    load_variants(renderer);
+}
+
+void Map::load_variants(SDL_Renderer *renderer)
+{
+    RxProgram program;
+    if (!rx_compile("assets/textures.rx", program))
+        return;
+
+    for (auto &image : rx_build(program, "cache"))
+    {
+        // Textures are named after the material they replace
+        auto &names = material_table.name;
+        auto material = std::find_if(names.begin(), names.end(), [&](const char *name) {
+            return SDL_strcasecmp(name, image.name.c_str()) == 0;
+        });
+        if (material == names.end() || material == names.begin() + M_VOID) {
+            std::cout << "No material for generated texture " << image.name << std::endl;
+            continue;
+        }
+
+        auto texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, image.width, image.height);
+        if (texture == nullptr) continue;
+
+        SDL_UpdateTexture(texture, nullptr, image.pixels.data(), image.width * 4);
+        variants[material - names.begin()].push_back(texture);
+        variant_images[material - names.begin()].push_back(std::move(image));
     }
 }
 
@@ -57,7 +86,48 @@ bool Map::load_file(std::string path)
         std::cout << "\tSpawn X: " << spawnx << std::endl;
         std::cout << "\tSpawn Y: " << spawny << std::endl;
 
-        tiles.resize(height, width);
+        // Checked first, past this point the previous level is gone
+        if (spawnx > width || spawny > height) {
+            std::cout << "Invalid spawn point" << std::endl;
+            return false;
+        }
+
+        // Drop the previous level, all of its memory goes back at once
+        chunks = ArenaVector<PackedChunk>(level);
+        dirty = ArenaVector<uint8_t>(level);
+        dirty_list = ArenaVector<size_t>(level);
+        source = ArenaVector<PackedChunk>(level);
+        modified = ArenaVector<uint8_t>(level);
+        modified_list = ArenaVector<size_t>(level);
+        changes = ArenaVector<TileChange>(level);
+        cached = ArenaVector<int16_t>(level);
+        level.release();
+
+        rows = height;
+        columns = width;
+
+        chunk_columns = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        size_t chunk_rows = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        chunks.resize(chunk_rows * chunk_columns);
+        source.resize(chunks.size());
+        dirty.assign(chunks.size(), D_NONE);
+        dirty_list.reserve(chunks.size());
+        modified.assign(chunks.size(), 0);
+        modified_list.reserve(chunks.size());
+        changes.reserve(MAX_TILE_CHANGES);
+        for (size_t chunk = 0; chunk < chunks.size(); chunk++)
+            mark_dirty(chunk, D_ALL);
+
+        cached.assign(chunks.size(), -1);
+        slot_count = std::min(CACHE_SLOTS, chunks.size());
+        slot_tiles = level.allocate<uint8_t>(slot_count * CHUNK_SIZE * CHUNK_SIZE);
+        slots = {};
+        cache = {};
+
+        // One row of chunks is parsed at a time, the whole map is never
+        // held uncompressed
+        auto band = std::make_unique<uint8_t[]>(chunk_columns * CHUNK_SIZE * CHUNK_SIZE);
+        std::fill_n(band.get(), chunk_columns * CHUNK_SIZE * CHUNK_SIZE, uint8_t(M_VOID));
 
         for (size_t row = 0; row < height; row++)
         {
@@ -66,68 +136,35 @@ bool Map::load_file(std::string path)
             {
                 Material material = M_VOID;
                 if (!end) {
-                    char c = infile.peek();
-                    infile.get();
-                    switch (c) {
-                        case ' ':
-                            break;
-
-                        case 'D':
-                            material = M_DIRT;
-                            break;
-
-                        case 'G':
-                            material = M_GRASS;
-                            break;
-
-                        case 'C':
-                            material = M_COAL;
-                            break;
-
-                        case 'L':
-                            material = M_LAPIS;
-                            break;
-
-                        case 'W':
-                            material = M_WATER;
-                            break;
-
-                        case 'F':
-                            material = M_FLOWER;
-                            break;
-
-                        case '\n':
-                            end = true;
-                            break;
-
-                        default:
+                    char c = infile.get();
+                    if (c == '\n') {
+                        end = true;
+                    } else {
+                        uint8_t found = material_table.by_symbol[uint8_t(c)];
+                        if (found == M_COUNT)
                             std::cout << "Invalid material " << int(c) << std::endl;
-                            break;
+                        else
+                            material = Material(found);
                     }
                 }
 
-                tiles[row][column].material = material;
-                tiles[row][column].collider.active = material != M_VOID && material != M_FLOWER;
-                tiles[row][column].collider.rect = {
-                    .x = float(column * tile_size),
-                    .y = float(row * tile_size),
-                    .w = float(tile_size),
-                    .h = float(tile_size),
-                };
+                size_t local_row = row % CHUNK_SIZE;
+                band[(column / CHUNK_SIZE * CHUNK_SIZE + local_row) * CHUNK_SIZE + column % CHUNK_SIZE] = material;
             }
 
             if (!end) infile.get();
-        }
 
-        if (spawnx > width || spawny > height) {
-            std::cout << "Invalid spawn point" << std::endl;
-            return false;
+            if (row % CHUNK_SIZE == CHUNK_SIZE - 1 || row + 1 == height) {
+                for (size_t chunk_column = 0; chunk_column < chunk_columns; chunk_column++) {
+                    size_t chunk = row / CHUNK_SIZE * chunk_columns + chunk_column;
+                    pack(source[chunk], band.get() + chunk_column * CHUNK_SIZE * CHUNK_SIZE, nullptr);
+                    chunks[chunk] = source[chunk];
+                }
+                std::fill_n(band.get(), chunk_columns * CHUNK_SIZE * CHUNK_SIZE, uint8_t(M_VOID));
+            }
         }
 
-        spawn_pos = {
-            float(spawnx * tile_size),
-            float(spawny * tile_size),
-        };
+        spawn_pos = WorldPos::tile(spawnx, spawny);
     } else {
         std::cout << "Invalid map header" << std::endl;
         return false;
@@ -137,52 +174,452 @@ bool Map::load_file(std::string path)
     return true;
 }
 
-void Map::render(SDL_Renderer *renderer, const SDL_FRect &camera)
+SDL_Rect Map::visible_area(const Camera &camera) const
+{
+    int64_t start_row = std::max<int64_t>(0, camera.pos.y.tile());
+    int64_t end_row   = std::min<int64_t>(rows, (camera.pos.y + to_fixed(camera.h)).tile() + 1);
+
+    int64_t start_col = std::max<int64_t>(0, camera.pos.x.tile());
+    int64_t end_col   = std::min<int64_t>(columns, (camera.pos.x + to_fixed(camera.w)).tile() + 1);
+
+    if (end_row <= start_row || end_col <= start_col)
+        return { 0, 0, 0, 0 };
+
+    return { int(start_col), int(start_row), int(end_col - start_col), int(end_row - start_row) };
+}
+
+Slice<TileDraw> Map::cull(const Camera &camera, float scale, Arena &frame)
 {
+    PROFILE_ZONE("Map::cull");
+
+    SDL_Rect area = visible_area(camera);
+    if (area.w == 0)
+        return Slice<TileDraw>(nullptr, 0);
+
+    auto visible = frame.allocate<TileDraw>(area.w * area.h);
+    return Slice(visible, cull_rows(camera, scale, area, area.y, area.y + area.h, visible));
+}
+
+size_t Map::cull_rows(const Camera &camera, float scale, const SDL_Rect &area, int row_begin, int row_end, TileDraw *out) const
+{
+    int col_begin = area.x;
+    int col_end = area.x + area.w;
+    size_t count = 0;
+
+    // The only conversion to float, relative to the camera and exact
+    Vec2<float> first = WorldPos::tile(col_begin, row_begin).minus(camera.pos);
+
+    // Chunk by chunk, each one is decoded once per band
+    uint8_t materials[CHUNK_SIZE * CHUNK_SIZE];
+    for (int chunk_row = row_begin - row_begin % CHUNK_SIZE; chunk_row < row_end; chunk_row += CHUNK_SIZE) {
+        int row0 = std::max(row_begin, chunk_row);
+        int row1 = std::min(row_end, chunk_row + CHUNK_SIZE);
+
+        for (int chunk_col = col_begin - col_begin % CHUNK_SIZE; chunk_col < col_end; chunk_col += CHUNK_SIZE) {
+            int col0 = std::max(col_begin, chunk_col);
+            int col1 = std::min(col_end, chunk_col + CHUNK_SIZE);
+            chunks[chunk_index(chunk_row, chunk_col)].decode(materials);
+
+            for (int row = row0; row < row1; row++) {
+                for (int column = col0; column < col1; column++) {
+                    auto material = Material(materials[(row - chunk_row) * CHUNK_SIZE + column - chunk_col]);
+                    if (material == M_VOID) continue;
+
+                    out[count++] = {
+                        .dst = {
+                            .x = (first.x + (column - col_begin)) * scale,
+                            .y = (first.y + (row - row_begin)) * scale,
+                            .w = scale,
+                            .h = scale,
+                        },
+                        .material = material,
+                        .variant = tile_variant(row, column),
+                    };
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+void Map::draw(SDL_Renderer *renderer, const Slice<TileDraw> &visible)
+{
+    for (auto &tile : visible) {
+        auto &generated = variants[tile.material];
+        auto texture = generated.empty() ? materials[tile.material] : generated[tile.variant % generated.size()];
+        SDL_RenderCopyF(renderer, texture, nullptr, &tile.dst);
+    }
+
+    if (!material_table.emissive) return;
+
+    // Emissive tiles add their light over the texture, one batch per
+    // material. A dark one adds nothing and is skipped.
+    for (auto &rects : glow)
+        rects.clear();
+    for (auto &tile : visible) {
+        if (material_table.light[tile.material].a > 0)
+            glow[tile.material].push_back(tile.dst);
+    }
+
+    SDL_BlendMode mode;
+    SDL_GetRenderDrawBlendMode(renderer, &mode);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_ADD);
+    for (int material = 0; material < M_COUNT; material++) {
+        if (glow[material].empty()) continue;
+
+        SDL_Color light = material_table.light[material];
+        SDL_SetRenderDrawColor(renderer, light.r, light.g, light.b, light.a);
+        SDL_RenderFillRectsF(renderer, glow[material].data(), int(glow[material].size()));
+    }
+    SDL_SetRenderDrawBlendMode(renderer, mode);
+}
+
+void Map::render(SDL_Renderer *renderer, const Camera &camera, float scale, Arena &frame)
+{
+    PROFILE_ZONE("Map::render");
+
     SDL_SetRenderDrawColor(renderer, 212, 241, 249, 255);
     SDL_RenderClear(renderer);
+    draw(renderer, cull(camera, scale, frame));
+}
+
+// Visit the tiles of a chunk inside the map with their index in the chunk
+template<typename F>
+static void each_chunk_tile(size_t chunk, size_t chunk_columns, size_t rows, size_t columns, F f)
+{
+    size_t row0 = chunk / chunk_columns * CHUNK_SIZE;
+    size_t column0 = chunk % chunk_columns * CHUNK_SIZE;
+    size_t row1 = std::min(rows, row0 + CHUNK_SIZE);
+    size_t column1 = std::min(columns, column0 + CHUNK_SIZE);
+
+    for (size_t row = row0; row < row1; row++)
+        for (size_t column = column0; column < column1; column++)
+            f(row, column, (row - row0) * CHUNK_SIZE + column - column0);
+}
 
-//  std::cout << "map(from: " << from << ", to: " << to << ")" << std::endl;
-//  std::cout << "map_scheme.size() = " << map_scheme.size() << " map_scheme[0].size() = " << map_scheme[0].size() << std::endl;
+static_assert(M_COUNT <= 16, "Packed chunks index materials with at most 4 bits");
 
-    int start_row = std::max(0, int(camera.y / tile_size));
-    int end_row   = std::min(int(tiles.rows), int(camera.y + camera.h) / tile_size + 1);
+void Map::pack(PackedChunk &packed, const uint8_t *materials, const PackedChunk *shared)
+{
+    // Palette in order of first use
+    uint8_t palette[M_COUNT];
+    uint8_t index_of[M_COUNT];
+    uint8_t palette_size = 0;
+    std::fill_n(index_of, M_COUNT, uint8_t(0xFF));
+
+    for (size_t i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++) {
+        uint8_t material = materials[i];
+        if (index_of[material] == 0xFF) {
+            index_of[material] = palette_size;
+            palette[palette_size++] = material;
+        }
+    }
 
-    int start_col = std::max(0, int(camera.x / tile_size));
-    int end_col   = std::min(int(tiles.columns), int(camera.x + camera.w) / tile_size + 1);
+    uint8_t bits = palette_size <= 1 ? 0 : palette_size <= 2 ? 1 : palette_size <= 4 ? 2 : 4;
+
+    // The arena never frees, a buffer only grows from 1 to 2 to 4 bits
+    bool reuse = packed.indices && packed.capacity >= bits && !(shared && packed.indices == shared->indices);
+    if (bits > 0 && !reuse) {
+        packed.indices = level.allocate<uint8_t>(PackedChunk::index_bytes(bits));
+        packed.capacity = bits;
+    }
 
-    for (auto row = start_row; row < end_row; row++) {
-        for (auto column = start_col; column < end_col; column++) {
-            auto &tile = tiles[row][column];
-            if (tile.material == M_VOID) continue;
+    std::memcpy(packed.palette, palette, palette_size);
+    packed.palette_size = palette_size;
+    packed.bits = bits;
+    if (bits == 0) return;
+
+    std::memset(packed.indices, 0, PackedChunk::index_bytes(bits));
+    for (size_t i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++) {
+        size_t bit = i * bits;
+        packed.indices[bit / 8] |= index_of[materials[i]] << (bit % 8);
+    }
+}
+
+void PackedChunk::decode(uint8_t *out) const
+{
+    if (bits == 0) {
+        std::memset(out, palette[0], CHUNK_SIZE * CHUNK_SIZE);
+        return;
+    }
+
+    uint8_t mask = (1 << bits) - 1;
+    for (size_t byte = 0; byte < index_bytes(bits); byte++) {
+        uint8_t packed = indices[byte];
+        for (int shift = 0; shift < 8; shift += bits)
+            *out++ = palette[(packed >> shift) & mask];
+    }
+}
 
-            SDL_FRect dst = {
-                .x = float(column * tile_size - camera.x),
-                .y = float(row * tile_size - camera.y),
-                .w = float(tile_size),
-                .h = float(tile_size),
-            };
-            SDL_RenderCopyF(renderer, materials[tile.material], nullptr, &dst);
+void PackedCopy::decode(uint8_t *out) const
+{
+    PackedChunk view;
+    std::memcpy(view.palette, palette, sizeof(palette));
+    view.palette_size = palette_size;
+    view.bits = bits;
+    view.indices = const_cast<uint8_t *>(indices);
+    view.decode(out);
+}
+
+static void copy_packed(const PackedChunk &packed, PackedCopy &copy)
+{
+    std::memcpy(copy.palette, packed.palette, sizeof(copy.palette));
+    copy.palette_size = packed.palette_size;
+    copy.bits = packed.bits;
+    if (packed.bits > 0)
+        std::memcpy(copy.indices, packed.indices, PackedChunk::index_bytes(packed.bits));
+}
+
+PackedChunk &Map::writable(size_t chunk)
+{
+    auto &packed = chunks[chunk];
+    if (packed.bits > 0 && packed.indices == source[chunk].indices) {
+        size_t bytes = PackedChunk::index_bytes(packed.bits);
+        auto copy = level.allocate<uint8_t>(bytes);
+        std::memcpy(copy, packed.indices, bytes);
+        packed.indices = copy;
+        packed.capacity = packed.bits;
+    }
+    return packed;
+}
+
+const uint8_t *Map::decoded(size_t chunk)
+{
+    cache_clock++;
+
+    int16_t slot = cached[chunk];
+    if (slot >= 0) {
+        cache.hits++;
+        slots[slot].used = cache_clock;
+        return slot_tiles + slot * CHUNK_SIZE * CHUNK_SIZE;
+    }
+
+    cache.misses++;
+    auto start = SDL_GetPerformanceCounter();
+
+    // Slots never used have a stamp of 0 and go first
+    slot = 0;
+    for (size_t i = 1; i < slot_count; i++)
+        if (slots[i].used < slots[slot].used) slot = int16_t(i);
+
+    if (slots[slot].used != 0)
+        cached[slots[slot].chunk] = -1;
+    slots[slot] = { chunk, cache_clock };
+    cached[chunk] = slot;
+
+    uint8_t *out = slot_tiles + slot * CHUNK_SIZE * CHUNK_SIZE;
+    chunks[chunk].decode(out);
+
+    cache.decode_ms += (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+    return out;
+}
+
+void Map::chunk_tiles(size_t chunk, Material *out) const
+{
+    for (size_t i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++)
+        out[i] = chunks[chunk].get(i);
+}
+
+void Map::chunk_source(size_t chunk, Material *out) const
+{
+    for (size_t i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++)
+        out[i] = source[chunk].get(i);
+}
+
+void Map::chunk_packed(size_t chunk, PackedCopy &current, PackedCopy &loaded) const
+{
+    copy_packed(chunks[chunk], current);
+    copy_packed(source[chunk], loaded);
+}
+
+void Map::set_chunk(size_t chunk, const Material *materials)
+{
+    if (chunk >= chunks.size()) return;
+
+    uint8_t previous[CHUNK_SIZE * CHUNK_SIZE];
+    chunks[chunk].decode(previous);
+
+    uint8_t packed_tiles[CHUNK_SIZE * CHUNK_SIZE];
+    std::fill_n(packed_tiles, CHUNK_SIZE * CHUNK_SIZE, uint8_t(M_VOID));
+    each_chunk_tile(chunk, chunk_columns, rows, columns, [&](size_t row, size_t column, size_t i) {
+        packed_tiles[i] = materials[i];
+        if (previous[i] != materials[i])
+            record_change(row, column, Material(previous[i]), materials[i]);
+    });
+
+    pack(chunks[chunk], packed_tiles, &source[chunk]);
+    if (cached[chunk] >= 0)
+        std::memcpy(slot_tiles + cached[chunk] * CHUNK_SIZE * CHUNK_SIZE, packed_tiles, CHUNK_SIZE * CHUNK_SIZE);
+
+    // Whole chunk changed, neighbours see new borders
+    mark_dirty(chunk, D_ALL);
+    size_t chunk_rows = dirty.size() / chunk_columns;
+    size_t chunk_row = chunk / chunk_columns, chunk_column = chunk % chunk_columns;
+    if (chunk_row > 0) mark_dirty(chunk - chunk_columns, D_LIGHT | D_NAV);
+    if (chunk_row + 1 < chunk_rows) mark_dirty(chunk + chunk_columns, D_LIGHT | D_NAV);
+    if (chunk_column > 0) mark_dirty(chunk - 1, D_LIGHT | D_NAV);
+    if (chunk_column + 1 < chunk_columns) mark_dirty(chunk + 1, D_LIGHT | D_NAV);
+
+    mark_modified(chunk);
+}
+
+void Map::revert()
+{
+    Material materials[CHUNK_SIZE * CHUNK_SIZE];
+    for (auto chunk : modified_list) {
+        chunk_source(chunk, materials);
+        set_chunk(chunk, materials);
+        modified[chunk] = 0;
+    }
+    modified_list.clear();
+}
+
+bool Map::set_tile(size_t row, size_t column, Material material)
+{
+    if (row >= rows || column >= columns)
+        return false;
+
+    size_t chunk = chunk_index(row, column);
+    size_t i = (row % CHUNK_SIZE) * CHUNK_SIZE + column % CHUNK_SIZE;
+    Material before = chunks[chunk].get(i);
+    if (before == material)
+        return true;
+
+    record_change(row, column, before, material);
+
+    auto &packed = writable(chunk);
+    size_t entry = std::find(packed.palette, packed.palette + packed.palette_size, material) - packed.palette;
+    if (entry == packed.palette_size && packed.palette_size < (1 << packed.bits))
+        packed.palette[packed.palette_size++] = material;
+
+    if (entry < packed.palette_size) {
+        size_t bit = i * packed.bits;
+        uint8_t mask = ((1 << packed.bits) - 1) << (bit % 8);
+        packed.indices[bit / 8] = (packed.indices[bit / 8] & ~mask) | (entry << (bit % 8));
+    } else {
+        // No room left in the palette at this width, pack it wider
+        uint8_t materials[CHUNK_SIZE * CHUNK_SIZE];
+        packed.decode(materials);
+        materials[i] = material;
+        pack(packed, materials, &source[chunk]);
+    }
+
+    if (cached[chunk] >= 0)
+        slot_tiles[cached[chunk] * CHUNK_SIZE * CHUNK_SIZE + i] = material;
+
+    mark_dirty(chunk, D_ALL);
+    mark_modified(chunk);
+
+    // Light and navigation spill over chunk borders
+    size_t local_row = row % CHUNK_SIZE;
+    size_t local_column = column % CHUNK_SIZE;
+
+    bool top = local_row == 0 && row > 0;
+    bool bottom = local_row == CHUNK_SIZE - 1 && row + 1 < rows;
+    bool left = local_column == 0 && column > 0;
+    bool right = local_column == CHUNK_SIZE - 1 && column + 1 < columns;
+
+    size_t next_row = top ? row - 1 : row + 1;
+    size_t next_column = left ? column - 1 : column + 1;
+
+    if (top || bottom)
+        mark_dirty(chunk_index(next_row, column), D_LIGHT | D_NAV);
+    if (left || right)
+        mark_dirty(chunk_index(row, next_column), D_LIGHT | D_NAV);
+
+    // A corner tile touches the diagonal chunk too
+    if ((top || bottom) && (left || right))
+        mark_dirty(chunk_index(next_row, next_column), D_LIGHT | D_NAV);
+
+    return true;
+}
+
+void Map::mark_dirty(size_t chunk, uint8_t flags)
+{
+    if (dirty[chunk] == D_NONE)
+        dirty_list.push_back(chunk);
+    dirty[chunk] |= flags;
+}
+
+void Map::mark_modified(size_t chunk)
+{
+    if (!modified[chunk]) {
+        modified[chunk] = 1;
+        modified_list.push_back(chunk);
+    }
+}
+
+void Map::record_change(size_t row, size_t column, Material before, Material after)
+{
+    if (changes.size() < MAX_TILE_CHANGES)
+        changes.push_back({ uint32_t(row), uint32_t(column), before, after });
+}
+
+void Map::clear_dirty(uint8_t flags)
+{
+    size_t kept = 0;
+    for (auto chunk : dirty_list) {
+        dirty[chunk] &= ~flags;
+        if (dirty[chunk] != D_NONE)
+            dirty_list[kept++] = chunk;
+    }
+    dirty_list.resize(kept);
+}
+
+uint64_t Map::hash() const
+{
+    uint64_t hash = fnv1a(&rows, sizeof(rows));
+    hash = fnv1a(&columns, sizeof(columns), hash);
+    for (size_t row = 0; row < rows; row++) {
+        for (size_t column = 0; column < columns; column++) {
+            Material material = tile(row, column);
+            hash = fnv1a(&material, sizeof(material), hash);
         }
     }
+    return hash;
+}
+
+size_t Map::packed_bytes() const
+{
+    size_t bytes = (chunks.size() + source.size()) * sizeof(PackedChunk);
+    for (size_t chunk = 0; chunk < chunks.size(); chunk++) {
+        bytes += PackedChunk::index_bytes(source[chunk].capacity);
+        if (chunks[chunk].indices != source[chunk].indices)
+            bytes += PackedChunk::index_bytes(chunks[chunk].capacity);
+    }
+    return bytes;
 }
 
-Slice<Tile*> Map::colliding(const Collider &other, Tile *(&scratch)[8])
+Slice<Tile> Map::colliding(const Collider &other, Tile (&scratch)[8])
 {
-    int approx_row = other.rect.y / tile_size;
-    int min_row = std::max(0, approx_row - 1);
-    int max_row = std::min(int(tiles.rows) - 1, approx_row + 1);
+    PROFILE_ZONE("Map::colliding");
 
-    int approx_column = other.rect.x / tile_size;
-    int min_column = std::max(0, approx_column - 1);
-    int max_column = std::min(int(tiles.columns) - 1, approx_column + 1);
+    int64_t approx_row = other.rect.y >> FIXED_BITS;
+    int64_t min_row = std::max<int64_t>(0, approx_row - 1);
+    int64_t max_row = std::min<int64_t>(rows - 1, approx_row + 1);
+
+    int64_t approx_column = other.rect.x >> FIXED_BITS;
+    int64_t min_column = std::max<int64_t>(0, approx_column - 1);
+    int64_t max_column = std::min<int64_t>(columns - 1, approx_column + 1);
 
     size_t idx = 0;
+    size_t last_chunk = SIZE_MAX;
+    const uint8_t *materials = nullptr;
     for (auto row = min_row; row <= max_row; row++) {
         for (auto column = min_column; column <= max_column; column++) {
-            auto &tile = tiles[row][column];
-            if (tile.collider.colliding(other))
-                scratch[idx++] = &tile;
+            // The neighbourhood spans at most four chunks
+            size_t chunk = chunk_index(row, column);
+            if (chunk != last_chunk) {
+                materials = decoded(chunk);
+                last_chunk = chunk;
+            }
+
+            auto material = Material(materials[row % CHUNK_SIZE * CHUNK_SIZE + column % CHUNK_SIZE]);
+
+            Collider collider(FixedRect::tile(column, row), material_solid(material));
+            if (idx < std::size(scratch) && collider.colliding(other))
+                scratch[idx++] = { material, collider };
         }
     }
 
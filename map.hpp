@@ -2,49 +2,257 @@
 
 #include <SDL2/SDL.h>
 #include <array>
+#include <cstdint>
+#include <vector>
 
+#include "arena.hpp"
 #include "collider.hpp"
+#include "material.hpp"
+#include "rx.hpp"
 #include "util.hpp"
 #include "vec2.hpp"
+#include "world.hpp"
 
-enum Material {
-    M_VOID,
-    M_DIRT,
-    M_LAPIS,
-    M_COAL,
-    M_GRASS,
-    M_WATER,
-    M_FLOWER,
-    M_COUNT
+enum ChunkDirty : uint8_t {
+    D_NONE = 0,
+    D_RENDER = 1 << 0,
+    D_LIGHT = 1 << 1,
+    D_NAV = 1 << 2,
+    D_ALL = D_RENDER | D_LIGHT | D_NAV,
 };
 
+// A tile as handed out by collision queries, tiles are stored packed
 struct Tile {
     Material material;
     Collider collider;
 };
 
+// A chunk kept compressed. Each tile is an index into a palette of the
+// materials the chunk uses, packed at 0, 1, 2 or 4 bits, so a chunk of a
+// single material has no indices at all.
+struct PackedChunk {
+    uint8_t palette[16];
+    uint8_t palette_size = 0;
+    uint8_t bits = 0;
+    // Bits the index buffer has room for, reused while it fits
+    uint8_t capacity = 0;
+    uint8_t *indices = nullptr;
+
+    Material get(size_t i) const
+    {
+        if (bits == 0) return Material(palette[0]);
+        size_t bit = i * bits;
+        return Material(palette[(indices[bit / 8] >> (bit % 8)) & ((1 << bits) - 1)]);
+    }
+
+    // All CHUNK_SIZE² materials, a byte each
+    void decode(uint8_t *out) const;
+
+    // Bytes of indices for a whole chunk at the given width
+    static constexpr size_t index_bytes(uint8_t bits) { return CHUNK_SIZE * CHUNK_SIZE * bits / 8; }
+};
+
+// A packed chunk copied out of the map with indices of its own, cheap to
+// take and decoded later on any thread
+struct PackedCopy {
+    uint8_t palette[16];
+    uint8_t palette_size = 0;
+    uint8_t bits = 0;
+    uint8_t indices[PackedChunk::index_bytes(4)];
+
+    void decode(uint8_t *out) const;
+};
+
+struct ChunkCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    // Spent decoding chunks on misses
+    double decode_ms = 0.0;
+};
+
+// Picks among the generated textures of a material, stable per tile
+// position so the map and its LOD agree
+inline uint8_t tile_variant(uint32_t row, uint32_t column)
+{
+    return uint8_t(mix64(uint64_t(row) << 32 | column));
+}
+
+// A visible tile queued for drawing
+struct TileDraw {
+    SDL_FRect dst;
+    Material material;
+    // From tile_variant
+    uint8_t variant;
+};
+
+// A tile that took a new material, kept for effects
+struct TileChange {
+    uint32_t row;
+    uint32_t column;
+    Material before;
+    Material after;
+};
+
+// Changes kept between drains, past it a change has no effects
+constexpr size_t MAX_TILE_CHANGES = 256;
+
 class Map {
 public:
-    void init(SDL_Renderer *renderer, int tile_size);
+    void init(SDL_Renderer *renderer);
 
     bool load_file(std::string path);
 
-    void render(SDL_Renderer *renderer, const SDL_FRect &camera);
+    // Visible tiles for the camera, allocated from the frame arena
+    Slice<TileDraw> cull(const Camera &camera, float scale, Arena &frame);
+
+    // Columns and rows of tiles the camera sees, empty when none
+    SDL_Rect visible_area(const Camera &camera) const;
+
+    // Visible tiles of rows [row_begin, row_end) of the area into out, which
+    // has room for every tile of those rows. Only reads the map, so bands of
+    // rows can be culled on several threads.
+    size_t cull_rows(const Camera &camera, float scale, const SDL_Rect &area, int row_begin, int row_end, TileDraw *out) const;
+
+    // Draws over what is there, render clears first
+    void draw(SDL_Renderer *renderer, const Slice<TileDraw> &visible);
+
+    // Scale is screen pixels per tile
+    void render(SDL_Renderer *renderer, const Camera &camera, float scale, Arena &frame);
+
+    // Solid tiles overlapping the collider, copied into scratch
+    Slice<Tile> colliding(const Collider &other, Tile (&scratch)[8]);
+
+    // Change a single tile, returns false when out of bounds
+    bool set_tile(size_t row, size_t column, Material material);
+
+    // Read straight from the packed chunk, the cache is left alone
+    Material tile(size_t row, size_t column) const
+    {
+        return chunks[chunk_index(row, column)].get((row % CHUNK_SIZE) * CHUNK_SIZE + column % CHUNK_SIZE);
+    }
+
+    size_t chunk_index(size_t row, size_t column) const
+    {
+        return (row / CHUNK_SIZE) * chunk_columns + column / CHUNK_SIZE;
+    }
+
+    size_t chunk_count() const { return chunks.size(); }
+
+    size_t chunks_x() const { return chunk_columns; }
 
-    Slice<Tile*> colliding(const Collider &other, Tile *(&scratch)[8]);
+    uint8_t chunk_dirty(size_t chunk) const { return dirty[chunk]; }
 
-    size_t width() const { return tiles.columns; }
+    // Copy the CHUNK_SIZE² materials of a chunk, void past the map edge
+    void chunk_tiles(size_t chunk, Material *out) const;
 
-    size_t height() const { return tiles.rows; }
+    // Same as chunk_tiles but as loaded from the map file
+    void chunk_source(size_t chunk, Material *out) const;
 
-    Vec2<float> spawn() const { return spawn_pos; }
+    // Copy a chunk and its loaded state without decoding either
+    void chunk_packed(size_t chunk, PackedCopy &current, PackedCopy &loaded) const;
+
+    // Overwrite a whole chunk, tiles past the map edge are ignored
+    void set_chunk(size_t chunk, const Material *tiles);
+
+    // Chunks edited since the map was loaded, may include reverted edits
+    const ArenaVector<size_t>& modified_chunks() const { return modified_list; }
+
+    // Restore every modified chunk to its loaded state
+    void revert();
+
+    // Tiles set_tile and set_chunk changed since the last clear, edits
+    // from any source, the first MAX_TILE_CHANGES of them
+    const ArenaVector<TileChange>& tile_changes() const { return changes; }
+
+    void clear_tile_changes() { changes.clear(); }
+
+    // Chunks with at least one dirty flag set, in the order they were touched
+    const ArenaVector<size_t>& dirty_chunks() const { return dirty_list; }
+
+    // Clear the given flags on every dirty chunk
+    void clear_dirty(uint8_t flags);
+
+    // Hash of every tile material
+    uint64_t hash() const;
+
+    // Palettes and indices of the current and loaded chunks
+    size_t packed_bytes() const;
+
+    const ChunkCacheStats &cache_stats() const { return cache; }
+
+    size_t width() const { return columns; }
+
+    size_t height() const { return rows; }
+
+    WorldPos spawn() const { return spawn_pos; }
 
     const std::string& file_path() const { return path; }
 
+    // Images generated by the texture script per material, in the order
+    // TileDraw::variant indexes them
+    const std::array<std::vector<RxImage>, M_COUNT> &generated() const { return variant_images; }
+
 private:
-    int tile_size;
+    void mark_dirty(size_t chunk, uint8_t flags);
+
+    void mark_modified(size_t chunk);
+
+    void record_change(size_t row, size_t column, Material before, Material after);
+
+    void load_variants(SDL_Renderer *renderer);
+
+    // Compress CHUNK_SIZE² materials into packed, reusing its buffer
+    // unless it is shared with the loaded chunk
+    void pack(PackedChunk &packed, const uint8_t *materials, const PackedChunk *shared);
+
+    // Materials of a chunk from the working set, decoded into the least
+    // recently used slot on a miss
+    const uint8_t *decoded(size_t chunk);
+
+    // Copy the indices of a chunk still sharing them with its loaded state
+    PackedChunk &writable(size_t chunk);
+
     std::string path;
     std::array<SDL_Texture *, M_COUNT> materials;
-    Matrix<Tile> tiles{0, 0};
-    Vec2<float> spawn_pos{0, 0};
+    // Generated by the texture script, used instead of materials when present
+    std::array<std::vector<SDL_Texture *>, M_COUNT> variants;
+    std::array<std::vector<RxImage>, M_COUNT> variant_images;
+    // Glowing tiles of the last draw by material, kept to reuse their memory
+    std::array<std::vector<SDL_FRect>, M_COUNT> glow;
+
+    // Owns every allocation living as long as the loaded map
+    Arena level{MEM_MAP};
+    size_t rows = 0;
+    size_t columns = 0;
+    WorldPos spawn_pos;
+
+    size_t chunk_columns = 0;
+    ArenaVector<PackedChunk> chunks{level};
+    ArenaVector<uint8_t> dirty{level};
+    ArenaVector<size_t> dirty_list{level};
+
+    // Chunks as loaded, the base snapshots are diffed against. Indices are
+    // shared with chunks until a chunk is first edited.
+    ArenaVector<PackedChunk> source{level};
+    ArenaVector<uint8_t> modified{level};
+    ArenaVector<size_t> modified_list{level};
+
+    ArenaVector<TileChange> changes{level};
+
+    // Decompressed working set serving collisions and edits. Culling
+    // skips it: updating the LRU would make cull_rows write, so bands
+    // decode each chunk they cover once, which costs a decode per visible
+    // chunk per frame instead of a hit.
+    static constexpr size_t CACHE_SLOTS = 64;
+    struct CacheSlot {
+        size_t chunk;
+        uint64_t used;
+    };
+    std::array<CacheSlot, CACHE_SLOTS> slots{};
+    uint8_t *slot_tiles = nullptr;
+    size_t slot_count = 0;
+    // Slot of every chunk, -1 when not cached
+    ArenaVector<int16_t> cached{level};
+    uint64_t cache_clock = 0;
+    ChunkCacheStats cache;
 };
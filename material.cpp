@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "material.hpp"
+#include "util.hpp"
+
+// World units are tiles, time is in milliseconds
+constexpr float AIR_FRICTION = 0.000004f;
+constexpr float GROUND_FRICTION = 0.00016f;
+
+constexpr SDL_Color NO_LIGHT = { 0, 0, 0, 0 };
+
+static constexpr MaterialDef MATERIAL_DEFS[M_COUNT] = {
+    // id, name, symbol, solid, friction, restitution, light, color, texture
+    { M_VOID,   "Void",   ' ', false, AIR_FRICTION,    0.0f, NO_LIGHT, { 212, 241, 249, 255 }, "" },
+    { M_DIRT,   "Dirt",   'D', true,  GROUND_FRICTION, 0.0f, NO_LIGHT, { 134, 96, 67, 255 },   "assets/dirt.png" },
+    { M_LAPIS,  "Lapis",  'L', true,  GROUND_FRICTION, 0.0f, NO_LIGHT, { 38, 67, 137, 255 },   "assets/lapis.png" },
+    { M_COAL,   "Coal",   'C', true,  GROUND_FRICTION, 0.0f, NO_LIGHT, { 60, 60, 60, 255 },    "assets/coal.png" },
+    { M_GRASS,  "Grass",  'G', true,  GROUND_FRICTION, 0.0f, NO_LIGHT, { 93, 148, 54, 255 },   "assets/grass.png" },
+    { M_WATER,  "Water",  'W', true,  GROUND_FRICTION, 0.0f, NO_LIGHT, { 64, 112, 220, 200 },  "assets/water.png" },
+    { M_FLOWER, "Flower", 'F', false, AIR_FRICTION,    0.0f, NO_LIGHT, { 214, 64, 72, 255 },   "assets/flower.png" },
+};
+
+static_assert(material_defs_valid(MATERIAL_DEFS), "Materials must follow the enum and use distinct symbols");
+
+constexpr MaterialTable BUILTIN_MATERIALS = make_material_table(MATERIAL_DEFS);
+
+MaterialTable material_table = BUILTIN_MATERIALS;
+
+static bool read_color(std::istream &in, SDL_Color &color)
+{
+    int r, g, b, a;
+    if (!(in >> r >> g >> b >> a)) return false;
+
+    auto byte = [](int value) { return value >= 0 && value <= 255; };
+    if (!byte(r) || !byte(g) || !byte(b) || !byte(a)) return false;
+
+    color = { uint8_t(r), uint8_t(g), uint8_t(b), uint8_t(a) };
+    return true;
+}
+
+bool load_materials(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file) return true;
+
+    MaterialDef defs[M_COUNT];
+    std::copy(std::begin(MATERIAL_DEFS), std::end(MATERIAL_DEFS), defs);
+    std::array<std::string, M_COUNT> textures;
+
+    std::string line;
+    for (size_t number = 1; std::getline(file, line); number++)
+    {
+        std::istringstream in(line.substr(0, line.find('#')));
+        std::string name, property;
+        if (!(in >> name)) continue;
+
+        auto def = std::find_if(defs, defs + M_COUNT, [&](const MaterialDef &def) {
+            return SDL_strcasecmp(def.name, name.c_str()) == 0;
+        });
+
+        bool ok = def != defs + M_COUNT && in >> property;
+        if (ok) {
+            if (property == "symbol")
+                ok = bool(in >> def->symbol);
+            else if (property == "solid")
+                ok = bool(in >> def->solid);
+            else if (property == "friction")
+                ok = bool(in >> def->friction);
+            else if (property == "restitution")
+                ok = bool(in >> def->restitution);
+            else if (property == "light")
+                ok = read_color(in, def->light);
+            else if (property == "color")
+                ok = read_color(in, def->color);
+            else if (property == "texture")
+                ok = bool(in >> textures[def->id]);
+            else
+                ok = false;
+
+            std::string rest;
+            ok = ok && !(in >> rest);
+        }
+
+        if (!ok) {
+            std::cout << "Invalid material override at " << path << ":" << number << std::endl;
+            return false;
+        }
+    }
+
+    if (!material_defs_valid(defs)) {
+        std::cout << "Materials share a symbol in " << path << std::endl;
+        return false;
+    }
+
+    // Kept for as long as the table points into them
+    static std::array<std::string, M_COUNT> loaded_textures;
+    loaded_textures = std::move(textures);
+    for (int i = 0; i < M_COUNT; i++)
+        if (!loaded_textures[i].empty())
+            defs[i].texture = loaded_textures[i].c_str();
+
+    material_table = make_material_table(defs);
+    std::cout << "Loaded materials: " << path << std::endl;
+    return true;
+}
+
+uint64_t material_hash()
+{
+    uint64_t hash = fnv1a(material_table.symbol.data(), sizeof(material_table.symbol));
+    hash = fnv1a(material_table.solid.data(), sizeof(material_table.solid), hash);
+    hash = fnv1a(material_table.friction.data(), sizeof(material_table.friction), hash);
+    return fnv1a(material_table.restitution.data(), sizeof(material_table.restitution), hash);
+}
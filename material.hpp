@@ -0,0 +1,107 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <array>
+#include <cstdint>
+#include <string>
+
+enum Material {
+    M_VOID,
+    M_DIRT,
+    M_LAPIS,
+    M_COAL,
+    M_GRASS,
+    M_WATER,
+    M_FLOWER,
+    M_COUNT
+};
+
+// One material as written down, see MATERIAL_DEFS in material.cpp
+struct MaterialDef {
+    Material id;
+    const char *name;
+    // Stands for it in map files
+    char symbol;
+    bool solid;
+    // Slows the thing down while it stands on it, tiles per ms², void's
+    // applies in the air
+    float friction;
+    // Share of the fall speed a landing on it bounces back
+    float restitution;
+    // Added over its tiles, zero alpha for none
+    SDL_Color light;
+    // Roughly the average of the texture, for effects drawn without one
+    SDL_Color color;
+    // Empty for materials never drawn
+    const char *texture;
+};
+
+// The definitions turned into dense arrays indexed by material, or by
+// character for the map parser, so lookups never branch on the material
+struct MaterialTable {
+    // M_COUNT for characters no material uses
+    std::array<uint8_t, 256> by_symbol;
+    std::array<char, M_COUNT> symbol;
+    std::array<const char *, M_COUNT> name;
+    std::array<bool, M_COUNT> solid;
+    std::array<float, M_COUNT> friction;
+    std::array<float, M_COUNT> restitution;
+    std::array<SDL_Color, M_COUNT> light;
+    std::array<SDL_Color, M_COUNT> color;
+    std::array<const char *, M_COUNT> texture;
+    // Some material gives off light, drawing skips the glow pass otherwise
+    bool emissive;
+};
+
+constexpr bool material_defs_valid(const MaterialDef (&defs)[M_COUNT])
+{
+    for (int i = 0; i < M_COUNT; i++) {
+        if (defs[i].id != i || defs[i].symbol == '\n') return false;
+        for (int j = 0; j < i; j++)
+            if (defs[i].symbol == defs[j].symbol) return false;
+    }
+    return true;
+}
+
+constexpr MaterialTable make_material_table(const MaterialDef (&defs)[M_COUNT])
+{
+    MaterialTable table{};
+    for (auto &material : table.by_symbol)
+        material = M_COUNT;
+
+    for (int i = 0; i < M_COUNT; i++) {
+        const MaterialDef &def = defs[i];
+        table.by_symbol[uint8_t(def.symbol)] = uint8_t(i);
+        table.symbol[i] = def.symbol;
+        table.name[i] = def.name;
+        table.solid[i] = def.solid;
+        table.friction[i] = def.friction;
+        table.restitution[i] = def.restitution;
+        table.light[i] = def.light;
+        table.color[i] = def.color;
+        table.texture[i] = def.texture;
+        table.emissive = table.emissive || def.light.a > 0;
+    }
+    return table;
+}
+
+// Built from the definitions at compile time, load_materials may replace it
+// before anything else reads it
+extern MaterialTable material_table;
+
+inline bool material_solid(Material material)
+{
+    return material_table.solid[material];
+}
+
+// Override the built-in definitions with a text file, one property a line:
+//   <material name> <property> <value>
+// where property is symbol, solid, friction, restitution, light (r g b a),
+// color (r g b a) or texture, and # starts a comment. A missing file keeps
+// the built-in table. It changes the simulation, so servers, clients and
+// replays need the same file.
+bool load_materials(const std::string &path);
+
+// Hash of the properties the simulation reads: symbols, solidity, friction
+// and restitution. Replays, snapshots and the server's welcome carry it.
+uint64_t material_hash();
@@ -0,0 +1,211 @@
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include "net.hpp"
+
+std::string NetAddress::str() const
+{
+    char host[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host));
+    return std::string(host) + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+bool parse_address(const std::string &text, NetAddress &address)
+{
+    auto colon = text.rfind(':');
+    if (colon == std::string::npos)
+        return false;
+
+    std::string host = text.substr(0, colon);
+    if (host == "localhost") host = "127.0.0.1";
+
+    int port = std::atoi(text.c_str() + colon + 1);
+    if (port <= 0 || port > 65535)
+        return false;
+
+    address.addr.sin_family = AF_INET;
+    address.addr.sin_port = htons(uint16_t(port));
+    return inet_pton(AF_INET, host.c_str(), &address.addr.sin_addr) == 1;
+}
+
+bool Socket::open(uint16_t port, bool loopback)
+{
+    close();
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        std::cout << "Unable to create socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    // Many clients share loopback in the soak test, keep bursts from dropping
+    int buffer = 1 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(loopback ? INADDR_LOOPBACK : INADDR_ANY);
+
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        std::cout << "Unable to bind port " << port << ": " << std::strerror(errno) << std::endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void Socket::close()
+{
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+}
+
+bool Socket::send(const NetAddress &to, const ByteWriter &packet)
+{
+    auto sent = sendto(fd, packet.bytes.data(), packet.size(), 0,
+                       reinterpret_cast<const sockaddr *>(&to.addr), sizeof(to.addr));
+    if (sent < 0)
+        return false;
+
+    bytes_sent += sent;
+    return true;
+}
+
+size_t Socket::receive(NetAddress &from, uint8_t *buffer, size_t len)
+{
+    socklen_t addr_len = sizeof(from.addr);
+    auto received = recvfrom(fd, buffer, len, 0, reinterpret_cast<sockaddr *>(&from.addr), &addr_len);
+    if (received <= 0)
+        return 0;
+
+    bytes_received += received;
+    return received;
+}
+
+uint16_t Socket::port() const
+{
+    sockaddr_in addr{};
+    socklen_t addr_len = sizeof(addr);
+    getsockname(fd, reinterpret_cast<sockaddr *>(&addr), &addr_len);
+    return ntohs(addr.sin_port);
+}
+
+void put_header(ByteWriter &packet, PacketKind kind)
+{
+    packet.put(NET_PROTOCOL);
+    packet.put(uint8_t(kind));
+}
+
+bool get_header(ByteReader &packet, PacketKind &kind)
+{
+    uint16_t protocol;
+    uint8_t value;
+    if (!packet.get(protocol) || protocol != NET_PROTOCOL || !packet.get(value) || value > P_DISCONNECT)
+        return false;
+
+    kind = PacketKind(value);
+    return true;
+}
+
+void apply_command(Thing &thing, const Command &command)
+{
+    if (command.dir != 0)
+        thing.move_input(command.dir);
+    else
+        thing.stop_input();
+
+    if (command.jump)
+        thing.jump();
+}
+
+void put_command(ByteWriter &packet, const Command &command)
+{
+    packet.put(command.seq);
+    packet.put(command.dir);
+    packet.put(uint8_t(command.jump));
+    packet.put(command.edit_count);
+
+    for (auto &edit : Slice(command.edits, command.edit_count)) {
+        packet.put_varint(edit.row);
+        packet.put_varint(edit.column);
+        packet.put(uint8_t(edit.material));
+    }
+}
+
+bool get_command(ByteReader &packet, Command &command)
+{
+    uint8_t jump;
+    if (!packet.get(command.seq) || !packet.get(command.dir) || !packet.get(jump)
+        || !packet.get(command.edit_count) || command.edit_count > MAX_COMMAND_EDITS)
+        return false;
+
+    command.jump = jump;
+    for (auto &edit : Slice(command.edits, command.edit_count)) {
+        uint8_t material;
+        if (!packet.get_varint(edit.row) || !packet.get_varint(edit.column)
+            || !packet.get(material) || material >= M_COUNT)
+            return false;
+        edit.material = Material(material);
+    }
+
+    return true;
+}
+
+enum ThingField : uint8_t {
+    TF_POS = 1,
+    TF_VEL = 2,
+    TF_ACCEL = 4,
+    TF_LANDING = 8,
+    TF_FLAGS = 16,
+};
+
+uint8_t put_thing_delta(ByteWriter &packet, const ThingState &base, const ThingState &state)
+{
+    auto differs = [](Vec2<float> a, Vec2<float> b) { return a.x != b.x || a.y != b.y; };
+
+    uint8_t mask = 0;
+    if (base.pos != state.pos) mask |= TF_POS;
+    if (differs(base.vel, state.vel)) mask |= TF_VEL;
+    if (differs(base.accel, state.accel)) mask |= TF_ACCEL;
+    if (base.landing != state.landing) mask |= TF_LANDING;
+    if (base.facing != state.facing || base.on_ground != state.on_ground || base.ground != state.ground) mask |= TF_FLAGS;
+
+    packet.put(mask);
+    if (mask & TF_POS) packet.put(state.pos);
+    if (mask & TF_VEL) packet.put(state.vel);
+    if (mask & TF_ACCEL) packet.put(state.accel);
+    if (mask & TF_LANDING) packet.put(state.landing);
+    if (mask & TF_FLAGS) packet.put(uint8_t((state.facing == F_RIGHT) | state.on_ground << 1 | state.ground << 2));
+    return mask;
+}
+
+bool get_thing_delta(ByteReader &packet, ThingState &state)
+{
+    uint8_t mask, flags;
+    if (!packet.get(mask))
+        return false;
+
+    if ((mask & TF_POS) && !packet.get(state.pos)) return false;
+    if ((mask & TF_VEL) && !packet.get(state.vel)) return false;
+    if ((mask & TF_ACCEL) && !packet.get(state.accel)) return false;
+    if ((mask & TF_LANDING) && !packet.get(state.landing)) return false;
+    if (mask & TF_FLAGS) {
+        if (!packet.get(flags)) return false;
+        if ((flags >> 2) >= M_COUNT) return false;
+        state.facing = (flags & 1) ? F_RIGHT : F_LEFT;
+        state.on_ground = flags & 2;
+        state.ground = Material(flags >> 2);
+    }
+
+    return true;
+}
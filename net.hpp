@@ -0,0 +1,110 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <cstdint>
+#include <string>
+
+#include "bytes.hpp"
+#include "map.hpp"
+#include "thing.hpp"
+
+constexpr uint16_t NET_PROTOCOL = 5;
+
+// Payload bound for one datagram, stays under common path MTUs
+constexpr size_t NET_MTU = 1200;
+
+// Either side gives up on the other after this long without a packet
+constexpr uint32_t NET_TIMEOUT_TICKS = 5 * 120;
+
+// Every packet starts with u16 protocol and u8 kind
+//   P_CONNECT:    nothing
+//   P_WELCOME:    u16 player id, u64 material hash, u16 path length, path bytes
+//   P_COMMANDS:   u32 acked snapshot, u32 x y w h camera in tiles,
+//                 varint count, oldest first: u32 seq, i8 dir, u8 jump,
+//                 u8 edit count, per: varint row, varint column, u8 material
+//   P_SNAPSHOT:   u32 id, u32 baseline (0 when full), u32 last processed seq,
+//                 varint removed count, varint ids,
+//                 varint changed count, per: varint id, thing delta,
+//                 varint chunk count, per: varint chunk, runs of tiles XOR source
+//   P_DISCONNECT: nothing
+enum PacketKind : uint8_t {
+    P_CONNECT,
+    P_WELCOME,
+    P_COMMANDS,
+    P_SNAPSHOT,
+    P_DISCONNECT,
+};
+
+struct NetAddress {
+    sockaddr_in addr{};
+
+    bool operator==(const NetAddress &other) const
+    {
+        return addr.sin_addr.s_addr == other.addr.sin_addr.s_addr && addr.sin_port == other.addr.sin_port;
+    }
+
+    std::string str() const;
+};
+
+// Accepts host:port, with host an IPv4 address or localhost
+bool parse_address(const std::string &text, NetAddress &address);
+
+// Non blocking UDP socket, counts the bytes it moves
+class Socket {
+public:
+    ~Socket() { close(); }
+
+    // Port 0 picks a free one, loopback binds to 127.0.0.1 only
+    bool open(uint16_t port, bool loopback);
+
+    void close();
+
+    bool send(const NetAddress &to, const ByteWriter &packet);
+
+    // Size of the received datagram, 0 when nothing is pending
+    size_t receive(NetAddress &from, uint8_t *buffer, size_t len);
+
+    uint16_t port() const;
+
+    size_t bytes_sent = 0;
+    size_t bytes_received = 0;
+
+private:
+    int fd = -1;
+};
+
+void put_header(ByteWriter &packet, PacketKind kind);
+
+bool get_header(ByteReader &packet, PacketKind &kind);
+
+struct TileEdit {
+    uint32_t row;
+    uint32_t column;
+    Material material;
+};
+
+// Edits past this in a single tick are dropped
+constexpr size_t MAX_COMMAND_EDITS = 4;
+
+// One tick of player input, the unit of both prediction and simulation
+struct Command {
+    uint32_t seq = 0;
+    int8_t dir = 0;
+    bool jump = false;
+    uint8_t edit_count = 0;
+    TileEdit edits[MAX_COMMAND_EDITS];
+};
+
+void put_command(ByteWriter &packet, const Command &command);
+
+bool get_command(ByteReader &packet, Command &command);
+
+// Apply the input of a command to a Thing, edits are left to the caller
+void apply_command(Thing &thing, const Command &command);
+
+// u8 mask of changed fields, then the fields that differ from base. The
+// flags byte packs facing, on_ground and the ground material from bit 2.
+// Returns the mask, 0 when nothing changed.
+uint8_t put_thing_delta(ByteWriter &packet, const ThingState &base, const ThingState &state);
+
+bool get_thing_delta(ByteReader &packet, ThingState &state);
@@ -0,0 +1,230 @@
+#include <algorithm>
+#include <cmath>
+
+#include "particles.hpp"
+#include "profile.hpp"
+
+// World units are tiles, time is in milliseconds
+constexpr float GRAVITY = 0.00002f;
+constexpr float MAX_FALL_SPEED = 0.02f;
+constexpr float RESTITUTION = 0.4f;
+// Sideways speed kept when bouncing off the ground
+constexpr float GROUND_FRICTION = 0.6f;
+// Longer frames are split so nothing skips over a tile
+constexpr float MAX_STEP_MS = 1000.0f / 60.0f;
+
+// The origin is this far up and left of the followed point, so relative
+// positions stay positive and truncating them gives the tile
+constexpr int64_t ORIGIN_MARGIN = 512;
+// Particles die this far right of or below the origin, the followed point
+// stays within ORIGIN_MARGIN / 2 of the middle of that square
+constexpr float ORIGIN_REACH = 2 * ORIGIN_MARGIN;
+
+constexpr float PARTICLE_SIZE = 0.15f;
+// Fade out over the last moments of their life
+constexpr float FADE_MS = 250.0f;
+
+void Particles::init(size_t capacity)
+{
+    storage.release();
+    this->capacity = capacity;
+    count = 0;
+    quads = 0;
+
+    x = storage.allocate<float>(capacity);
+    y = storage.allocate<float>(capacity);
+    vx = storage.allocate<float>(capacity);
+    vy = storage.allocate<float>(capacity);
+    life = storage.allocate<float>(capacity);
+    color = storage.allocate<SDL_Color>(capacity);
+    corners = storage.allocate<SDL_FPoint>(capacity * 4);
+    tints = storage.allocate<SDL_Color>(capacity * 4);
+    indices = storage.allocate<int>(capacity * 6);
+
+    // Two triangles a quad
+    for (size_t i = 0; i < capacity; i++) {
+        int first = int(i * 4);
+        int *quad = indices + i * 6;
+        quad[0] = first;
+        quad[1] = first + 1;
+        quad[2] = first + 2;
+        quad[3] = first;
+        quad[4] = first + 2;
+        quad[5] = first + 3;
+    }
+}
+
+void Particles::rebase(int64_t column, int64_t row)
+{
+    float dx = float(origin_column - column);
+    float dy = float(origin_row - row);
+    for (size_t i = 0; i < count; i++) {
+        x[i] += dx;
+        y[i] += dy;
+    }
+    origin_column = column;
+    origin_row = row;
+}
+
+void Particles::follow(const WorldPos &centre)
+{
+    // Only in big steps, the particles left behind die once they are
+    // outside the square update keeps
+    int64_t column = centre.x.tile() - ORIGIN_MARGIN;
+    int64_t row = centre.y.tile() - ORIGIN_MARGIN;
+    if (count == 0 || std::abs(column - origin_column) > ORIGIN_MARGIN / 2 || std::abs(row - origin_row) > ORIGIN_MARGIN / 2)
+        rebase(column, row);
+}
+
+void Particles::emit(const WorldPos &pos, SDL_Color tint, size_t amount, float speed, float lifetime)
+{
+    amount = std::min(amount, capacity - count);
+    if (amount == 0) return;
+
+    // Outside the square update keeps it would die right away
+    Vec2<float> at = pos.minus(WorldPos::tile(origin_column, origin_row));
+    if (at.x < 0.0f || at.x >= ORIGIN_REACH || at.y < 0.0f || at.y >= ORIGIN_REACH) return;
+
+    // Angles of the upper half, y grows downwards
+    std::uniform_real_distribution<float> angle(-float(M_PI), 0.0f);
+    std::uniform_real_distribution<float> spread(0.25f, 1.0f);
+
+    for (size_t i = count; i < count + amount; i++) {
+        float a = angle(rng);
+        float s = speed * spread(rng);
+        x[i] = at.x;
+        y[i] = at.y;
+        vx[i] = std::cos(a) * s;
+        vy[i] = std::sin(a) * s;
+        life[i] = lifetime * spread(rng);
+        color[i] = tint;
+    }
+    count += amount;
+}
+
+void Particles::update(const Map &map, float delta)
+{
+    PROFILE_ZONE("Particles::update");
+
+    if (count == 0) {
+        update_ms = 0.0f;
+        return;
+    }
+
+    auto start = SDL_GetPerformanceCounter();
+
+    // The map, or the square around the bursts where it is larger,
+    // relative to the origin
+    const float left = std::max(0.0f, float(-origin_column));
+    const float right = std::min(float(int64_t(map.width()) - origin_column), ORIGIN_REACH);
+    const float bottom = std::min(float(int64_t(map.height()) - origin_row), ORIGIN_REACH);
+    auto solid = [&](float px, float py) {
+        int64_t row = origin_row + int64_t(py);
+        return row >= 0 && material_solid(map.tile(size_t(row), size_t(origin_column + int64_t(px))));
+    };
+
+    while (delta > 0.0f) {
+        float step = std::min(delta, MAX_STEP_MS);
+        delta -= step;
+
+        // No branches and no aliasing, the compiler turns this into SIMD
+        float *__restrict px = x;
+        float *__restrict py = y;
+        float *__restrict pvx = vx;
+        float *__restrict pvy = vy;
+        float *__restrict plife = life;
+        for (size_t i = 0; i < count; i++) {
+            float v = std::min(pvy[i] + GRAVITY * step, MAX_FALL_SPEED);
+            pvy[i] = v;
+            px[i] += pvx[i] * step;
+            py[i] += v * step;
+            plife[i] -= step;
+        }
+
+        // Bounce off whatever solid tile they moved into and move the
+        // survivors down over the dead. The tile they were in was open,
+        // most steps do not leave it and need no lookup.
+        size_t kept = 0;
+        for (size_t i = 0; i < count; i++) {
+            float cx = x[i], cy = y[i], cvx = vx[i], cvy = vy[i];
+            if (life[i] <= 0.0f || cx < left || cx >= right || cy < 0.0f || cy >= bottom) continue;
+
+            float ox = cx - cvx * step;
+            float oy = cy - cvy * step;
+            bool moved = int(cx) != int(ox) || int(cy) != int(oy);
+
+            if (moved && solid(cx, cy)) {
+                // Buried by an edit
+                if (ox < left || ox >= right || oy < 0.0f || oy >= bottom || solid(ox, oy)) continue;
+
+                // Moving only vertically would have hit it too, so it is a floor or a ceiling
+                if (solid(ox, cy)) {
+                    cvy = -cvy * RESTITUTION;
+                    cvx *= GROUND_FRICTION;
+                } else {
+                    cvx = -cvx * RESTITUTION;
+                }
+                cx = ox;
+                cy = oy;
+            }
+
+            x[kept] = cx;
+            y[kept] = cy;
+            vx[kept] = cvx;
+            vy[kept] = cvy;
+            if (kept != i) {
+                life[kept] = life[i];
+                color[kept] = color[i];
+            }
+            kept++;
+        }
+        count = kept;
+    }
+
+    update_ms = (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+}
+
+void Particles::build(const Camera &camera, float scale)
+{
+    PROFILE_ZONE("Particles::build");
+
+    // The camera relative to the origin, exact while the two are near
+    Vec2<float> view = camera.pos.minus(WorldPos::tile(origin_column, origin_row));
+
+    // Never thinner than a pixel, however far out the zoom is
+    const float side = std::max(1.0f, PARTICLE_SIZE * scale);
+    const float left = view.x - PARTICLE_SIZE;
+    const float top = view.y - PARTICLE_SIZE;
+    const float right = view.x + camera.w + PARTICLE_SIZE;
+    const float bottom = view.y + camera.h + PARTICLE_SIZE;
+
+    quads = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (x[i] < left || x[i] >= right || y[i] < top || y[i] >= bottom) continue;
+
+        float sx = (x[i] - view.x) * scale - side * 0.5f;
+        float sy = (y[i] - view.y) * scale - side * 0.5f;
+        SDL_Color c = color[i];
+        c.a = uint8_t(c.a * std::min(1.0f, life[i] / FADE_MS));
+
+        SDL_FPoint *quad = corners + quads * 4;
+        quad[0] = { sx, sy };
+        quad[1] = { sx + side, sy };
+        quad[2] = { sx + side, sy + side };
+        quad[3] = { sx, sy + side };
+        SDL_Color *tint = tints + quads * 4;
+        tint[0] = tint[1] = tint[2] = tint[3] = c;
+        quads++;
+    }
+}
+
+void Particles::draw(SDL_Renderer *renderer)
+{
+    if (quads == 0) return;
+
+    PROFILE_ZONE("Particles::draw");
+
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_RenderGeometryRaw(renderer, nullptr, &corners->x, sizeof(SDL_FPoint), tints, sizeof(SDL_Color),
+                          nullptr, 0, int(quads * 4), indices, int(quads * 6), sizeof(int));
+}
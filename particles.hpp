@@ -0,0 +1,83 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <cstdint>
+#include <random>
+
+#include "arena.hpp"
+#include "map.hpp"
+#include "vec2.hpp"
+#include "world.hpp"
+
+// Most particles alive at once, emitting into a full pool drops the rest
+constexpr size_t MAX_PARTICLES = 1 << 18;
+
+struct ParticleStats {
+    size_t live = 0;
+    size_t drawn = 0;
+    float update_ms = 0.0f;
+};
+
+// Debris and droplets, purely cosmetic so never part of the simulation
+// state. Each field is its own array and the live particles are kept at
+// the front, so integrating them is a straight loop over floats.
+// Positions are floats relative to an origin tile near the camera, those
+// straying too far from it are culled before they lose precision.
+// Everything visible is drawn with a single SDL_RenderGeometryRaw call.
+class Particles {
+public:
+    // Storage for capacity particles, emitting before this does nothing
+    void init(size_t capacity = MAX_PARTICLES);
+
+    // Keep the origin near centre, the camera's. Moving it shifts every
+    // live particle, so it moves once centre strayed a few hundred tiles.
+    void follow(const WorldPos &centre);
+
+    // Burst of count particles from pos, flung upwards at up to speed
+    // tiles per ms and living up to life ms. Nothing is emitted outside
+    // the square update keeps.
+    void emit(const WorldPos &pos, SDL_Color color, size_t count, float speed, float life);
+
+    void clear() { count = 0; }
+
+    // Advance delta ms, particles bounce off solid tiles and die past the
+    // map sides or bottom, or outside a square of a few hundred tiles
+    // around the followed point. Only reads the map.
+    void update(const Map &map, float delta);
+
+    // Quads of the particles the camera sees, scale is pixels per tile
+    void build(const Camera &camera, float scale);
+
+    // Whatever the last build kept, main thread only
+    void draw(SDL_Renderer *renderer);
+
+    ParticleStats stats() const { return { count, quads, update_ms }; }
+
+private:
+    // Move the origin, and the live particles along with it
+    void rebase(int64_t column, int64_t row);
+
+    Arena storage{MEM_PARTICLES};
+    size_t capacity = 0;
+    size_t count = 0;
+    int64_t origin_column = 0;
+    int64_t origin_row = 0;
+
+    float *x = nullptr;
+    float *y = nullptr;
+    float *vx = nullptr;
+    float *vy = nullptr;
+    // Milliseconds left
+    float *life = nullptr;
+    SDL_Color *color = nullptr;
+
+    // Four vertices a quad, the indices never change. Untextured, so
+    // positions and colours are all SDL_RenderGeometryRaw gets.
+    SDL_FPoint *corners = nullptr;
+    SDL_Color *tints = nullptr;
+    int *indices = nullptr;
+    size_t quads = 0;
+
+    float update_ms = 0.0f;
+    std::minstd_rand rng;
+};
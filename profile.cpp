@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "arena.hpp"
+#include "profile.hpp"
+#include "util.hpp"
+
+#include "imgui.h"
+
+namespace profile {
+
+std::atomic<bool> enabled = false;
+std::atomic<uint32_t> frame = 0;
+
+// Slot of a ring guarded by a sequence number, odd while its owner
+// writes it and 2 * (index + 1) once event index is complete
+struct RingSlot {
+    std::atomic<size_t> seq = 0;
+    std::atomic<const char *> name = nullptr;
+    std::atomic<uint64_t> start = 0;
+    std::atomic<uint64_t> end = 0;
+    std::atomic<uint32_t> frame = 0;
+    std::atomic<uint32_t> depth = 0;
+};
+
+// Written only by its owning thread, read by the debug window
+struct Ring {
+    static constexpr size_t CAPACITY = 1 << 16;
+
+    std::array<RingSlot, CAPACITY> slots;
+    std::atomic<size_t> head = 0;
+    uint32_t thread;
+};
+
+static std::mutex rings_mutex;
+static std::vector<std::unique_ptr<Ring>> rings;
+
+// Start counter of recent frames, indexed by frame number
+static constexpr size_t FRAME_HISTORY = 1024;
+static std::array<uint64_t, FRAME_HISTORY> frame_start;
+
+static Ring &thread_ring()
+{
+    thread_local Ring *ring = nullptr;
+    if (ring == nullptr) {
+        std::lock_guard lock(rings_mutex);
+        rings.push_back(std::make_unique<Ring>());
+        memory::reserve(MEM_PROFILER, sizeof(Ring));
+        memory::use(MEM_PROFILER, sizeof(Ring));
+        ring = rings.back().get();
+        ring->thread = rings.size();
+    }
+    return *ring;
+}
+
+uint32_t &depth()
+{
+    thread_local uint32_t depth = 0;
+    return depth;
+}
+
+void push(const char *name, uint64_t start, uint64_t end, uint32_t depth)
+{
+    auto &ring = thread_ring();
+    size_t head = ring.head.load(std::memory_order_relaxed);
+    auto &slot = ring.slots[head % Ring::CAPACITY];
+
+    slot.seq.store(2 * head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.frame.store(frame.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    slot.depth.store(depth, std::memory_order_relaxed);
+    slot.seq.store(2 * head + 2, std::memory_order_release);
+
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void new_frame()
+{
+    uint32_t next = frame.load(std::memory_order_relaxed) + 1;
+    frame_start[next % FRAME_HISTORY] = SDL_GetPerformanceCounter();
+    frame.store(next, std::memory_order_relaxed);
+}
+
+// Copy event index out of its slot, false when the owner has started
+// overwriting it since
+static bool read_slot(const Ring &ring, size_t index, ProfileEvent &event)
+{
+    auto &slot = ring.slots[index % Ring::CAPACITY];
+    size_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq != 2 * index + 2)
+        return false;
+
+    event = {
+        .name = slot.name.load(std::memory_order_relaxed),
+        .start = slot.start.load(std::memory_order_relaxed),
+        .end = slot.end.load(std::memory_order_relaxed),
+        .frame = slot.frame.load(std::memory_order_relaxed),
+        .depth = slot.depth.load(std::memory_order_relaxed),
+    };
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.seq.load(std::memory_order_relaxed) == seq;
+}
+
+// Visit the events still held by every ring, oldest first. Events the
+// owner overwrites while they are visited are skipped
+template<typename F>
+static void each_event(F f)
+{
+    std::lock_guard lock(rings_mutex);
+    for (auto &ring : rings) {
+        size_t head = ring->head.load(std::memory_order_acquire);
+        size_t tail = head > Ring::CAPACITY ? head - Ring::CAPACITY : 0;
+        for (size_t i = tail; i < head; i++) {
+            ProfileEvent event;
+            if (read_slot(*ring, i, event))
+                f(*ring, event);
+        }
+    }
+}
+
+bool dump_chrome_trace(const std::string &path, float seconds)
+{
+    std::ofstream file(path);
+    if (!file)
+        return false;
+
+    const double freq = SDL_GetPerformanceFrequency();
+    uint64_t now = SDL_GetPerformanceCounter();
+    uint64_t from = now - std::min<uint64_t>(now, seconds * freq);
+
+    file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    bool first = true;
+    each_event([&](const Ring &ring, const ProfileEvent &event) {
+        if (event.start < from) return;
+
+        file << (first ? "" : ",") << "\n{\"name\":\"" << event.name
+             << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring.thread
+             << ",\"ts\":" << (event.start - from) / freq * 1e6
+             << ",\"dur\":" << (event.end - event.start) / freq * 1e6
+             << ",\"args\":{\"frame\":" << event.frame << "}}";
+        first = false;
+    });
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    return bool(file);
+}
+
+// Stable color per zone name
+static ImU32 zone_color(const char *name)
+{
+    uint64_t hash = fnv1a(name, std::char_traits<char>::length(name));
+    return IM_COL32(60 + (hash & 0x7f), 60 + (hash >> 8 & 0x7f), 60 + (hash >> 16 & 0x7f), 255);
+}
+
+struct ZoneStats {
+    double total = 0;
+    double max = 0;
+    size_t calls = 0;
+};
+
+void render_tab()
+{
+    bool on = enabled.load();
+    if (ImGui::Checkbox("Enabled", &on))
+        enabled.store(on);
+
+    ImGui::SameLine();
+    ImGui::Text("F9 dumps the last 5 s as trace.json");
+
+    uint32_t current = frame.load();
+    if (!on || current < 2) return;
+
+    // Timeline of the last complete frame, one row per thread and depth
+    const double freq = SDL_GetPerformanceFrequency();
+    uint32_t shown = current - 1;
+    uint64_t begin = frame_start[shown % FRAME_HISTORY];
+    uint64_t end = frame_start[current % FRAME_HISTORY];
+    double frame_ms = (end - begin) / freq * 1000.0;
+
+    ImGui::Text("Frame %u: %.3f ms", shown, frame_ms);
+
+    constexpr float ROW_HEIGHT = 18.0f;
+    constexpr uint32_t MAX_ROWS = 8;
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    float width = ImGui::GetContentRegionAvail().x;
+    auto draw = ImGui::GetWindowDrawList();
+
+    uint32_t rows = 1;
+    each_event([&](const Ring &ring, const ProfileEvent &event) {
+        if (event.frame != shown || event.end <= begin) return;
+
+        uint32_t row = std::min((ring.thread - 1) * 4 + event.depth, MAX_ROWS - 1);
+        rows = std::max(rows, row + 1);
+
+        float x0 = origin.x + width * float(std::max(event.start, begin) - begin) / float(end - begin);
+        float x1 = origin.x + width * float(std::min(event.end, end) - begin) / float(end - begin);
+        float y0 = origin.y + row * ROW_HEIGHT;
+
+        draw->AddRectFilled(ImVec2(x0, y0), ImVec2(std::max(x1, x0 + 1.0f), y0 + ROW_HEIGHT - 2), zone_color(event.name));
+        draw->PushClipRect(ImVec2(x0, y0), ImVec2(x1, y0 + ROW_HEIGHT), true);
+        draw->AddText(ImVec2(x0 + 2, y0 + 1), IM_COL32(255, 255, 255, 255), event.name);
+        draw->PopClipRect();
+    });
+    ImGui::Dummy(ImVec2(width, rows * ROW_HEIGHT));
+
+    // Rolling statistics over the last frames
+    constexpr uint32_t ROLLING_FRAMES = 120;
+    uint32_t oldest = shown > ROLLING_FRAMES ? shown - ROLLING_FRAMES : 0;
+    std::map<std::string, ZoneStats> stats;
+
+    each_event([&](const Ring &, const ProfileEvent &event) {
+        if (event.frame <= oldest || event.frame > shown) return;
+
+        double ms = (event.end - event.start) / freq * 1000.0;
+        auto &zone = stats[event.name];
+        zone.total += ms;
+        zone.max = std::max(zone.max, ms);
+        zone.calls++;
+    });
+
+    uint32_t frames = shown - oldest;
+    if (ImGui::BeginTable("ProfilerStats", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Zone");
+        ImGui::TableSetupColumn("Avg ms/frame");
+        ImGui::TableSetupColumn("Max ms");
+        ImGui::TableSetupColumn("Calls/frame");
+        ImGui::TableHeadersRow();
+
+        for (auto &[name, zone] : stats) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", zone.total / frames);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", zone.max);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.1f", double(zone.calls) / frames);
+        }
+        ImGui::EndTable();
+    }
+}
+
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Build with -DTHING_PROFILE=0 to compile every zone out
+#ifndef THING_PROFILE
+#define THING_PROFILE 1
+#endif
+
+struct ProfileEvent {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+    uint32_t frame;
+    uint32_t depth;
+};
+
+namespace profile {
+
+extern std::atomic<bool> enabled;
+extern std::atomic<uint32_t> frame;
+
+// Append a finished zone to the calling thread's ring buffer
+void push(const char *name, uint64_t start, uint64_t end, uint32_t depth);
+
+uint32_t &depth();
+
+// Mark the start of a new frame on the main thread
+void new_frame();
+
+// Write zones from the last seconds as Chrome trace JSON (chrome://tracing)
+bool dump_chrome_trace(const std::string &path, float seconds);
+
+// Debug window tab with a timeline of the last frame and rolling statistics
+void render_tab();
+
+}
+
+class ProfileZone {
+public:
+    explicit ProfileZone(const char *name)
+    {
+        if (!profile::enabled.load(std::memory_order_relaxed)) return;
+
+        this->name = name;
+        depth = profile::depth()++;
+        start = SDL_GetPerformanceCounter();
+    }
+
+    ~ProfileZone()
+    {
+        if (name == nullptr) return;
+
+        profile::push(name, start, SDL_GetPerformanceCounter(), depth);
+        profile::depth()--;
+    }
+
+    ProfileZone(const ProfileZone &) = delete;
+    ProfileZone &operator=(const ProfileZone &) = delete;
+
+private:
+    const char *name = nullptr;
+    uint64_t start = 0;
+    uint32_t depth = 0;
+};
+
+#define profile_concat_inner(a, b) a##b
+#define profile_concat(a, b) profile_concat_inner(a, b)
+
+#if THING_PROFILE
+#define PROFILE_ZONE(name) ProfileZone profile_concat(profile_zone_, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
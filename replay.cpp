@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cstring>
+
+#include "replay.hpp"
+
+static const char REPLAY_MAGIC[4] = { 'T', 'H', 'R', 'C' };
+static const uint16_t REPLAY_VERSION = 5;
+static const uint8_t REPLAY_END = 0xff;
+static const uint8_t REPLAY_END_UNHASHED = 0xfe;
+
+bool Recorder::open(const std::string &path, uint32_t seed, const std::string &map_path)
+{
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file)
+        return false;
+
+    file.write(REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+    put(REPLAY_VERSION);
+    put(material_hash());
+    put(seed);
+    put(uint16_t(map_path.size()));
+    file.write(map_path.data(), map_path.size());
+
+    last_tick = 0;
+    return true;
+}
+
+void Recorder::write(const Input &input)
+{
+    put_varint(input.tick - last_tick);
+    last_tick = input.tick;
+    put(uint8_t(input.kind));
+
+    switch (input.kind)
+    {
+        case I_MOVE:
+            put(input.dir);
+            break;
+
+        case I_STOP:
+        case I_JUMP:
+            break;
+
+        case I_EDIT:
+            put_varint(input.row);
+            put_varint(input.column);
+            put(uint8_t(input.material));
+            break;
+
+        case I_STRESS:
+            put(uint8_t(input.on));
+            break;
+    }
+}
+
+void Recorder::close(uint32_t ticks, uint64_t hash)
+{
+    put_varint(ticks - last_tick);
+    put(REPLAY_END);
+    put(hash);
+    file.close();
+}
+
+void Recorder::close(uint32_t ticks)
+{
+    put_varint(ticks - last_tick);
+    put(REPLAY_END_UNHASHED);
+    file.close();
+}
+
+void Recorder::put_varint(uint32_t value)
+{
+    while (value >= 0x80) {
+        put(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    put(uint8_t(value));
+}
+
+template<typename T>
+static bool get(std::ifstream &file, T &value)
+{
+    uint8_t bytes[sizeof(T)];
+    if (!file.read(reinterpret_cast<char *>(bytes), sizeof(bytes)))
+        return false;
+
+    uint64_t bits = 0;
+    for (size_t i = 0; i < sizeof(T); i++)
+        bits |= uint64_t(bytes[i]) << (8 * i);
+
+    if constexpr (std::is_floating_point_v<T>) {
+        uint32_t raw = uint32_t(bits);
+        std::memcpy(&value, &raw, sizeof(value));
+    } else {
+        value = T(bits);
+    }
+    return true;
+}
+
+static bool get_varint(std::ifstream &file, uint32_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t byte;
+        if (!get(file, byte))
+            return false;
+
+        value |= uint32_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool is_replay(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(REPLAY_MAGIC)];
+    return file.read(magic, sizeof(magic)) && std::memcmp(magic, REPLAY_MAGIC, sizeof(magic)) == 0;
+}
+
+bool load_replay(const std::string &path, InputScript &script, uint64_t &hash, bool &has_hash)
+{
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(REPLAY_MAGIC)];
+    uint16_t version, path_len;
+
+    if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0) {
+        std::cout << "Invalid replay header" << std::endl;
+        return false;
+    }
+
+    if (!get(file, version) || version != REPLAY_VERSION) {
+        std::cout << "Unsupported replay version" << std::endl;
+        return false;
+    }
+
+    uint64_t materials;
+    if (!get(file, materials))
+        return false;
+
+    if (materials != material_hash()) {
+        std::cout << "Replay was recorded with different materials" << std::endl;
+        return false;
+    }
+
+    if (!get(file, script.seed) || !get(file, path_len))
+        return false;
+
+    script.map_path.resize(path_len);
+    if (!file.read(script.map_path.data(), path_len))
+        return false;
+
+    script.inputs.clear();
+    uint32_t tick = 0;
+
+    while (true)
+    {
+        uint32_t delta;
+        uint8_t kind;
+        if (!get_varint(file, delta) || !get(file, kind))
+            break;
+
+        tick += delta;
+        if (kind == REPLAY_END) {
+            script.ticks = tick;
+            has_hash = true;
+            return get(file, hash);
+        }
+
+        if (kind == REPLAY_END_UNHASHED) {
+            script.ticks = tick;
+            has_hash = false;
+            return true;
+        }
+
+        Input input;
+        input.tick = tick;
+        input.kind = InputKind(kind);
+
+        bool ok = true;
+        switch (input.kind)
+        {
+            case I_MOVE:
+                ok = get(file, input.dir);
+                break;
+
+            case I_STOP:
+            case I_JUMP:
+                break;
+
+            case I_EDIT: {
+                uint8_t material;
+                ok = get_varint(file, input.row) && get_varint(file, input.column)
+                    && get(file, material) && material < M_COUNT;
+                input.material = Material(material);
+                break;
+            }
+
+            case I_STRESS: {
+                uint8_t on;
+                ok = get(file, on);
+                input.on = on;
+                break;
+            }
+
+            default:
+                ok = false;
+                break;
+        }
+
+        if (!ok)
+            break;
+
+        script.inputs.push_back(input);
+    }
+
+    std::cout << "Truncated replay: " << path << std::endl;
+    return false;
+}
+
+float FrameStats::percentile(float fraction)
+{
+    if (samples.empty()) return 0.0f;
+
+    size_t n = std::min(samples.size() - 1, size_t(fraction * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + n, samples.end());
+    return samples[n];
+}
+
+float FrameStats::max()
+{
+    if (samples.empty()) return 0.0f;
+    return *std::max_element(samples.begin(), samples.end());
+}
+
+void FrameStats::report(std::ostream &os)
+{
+    os << "Frame times (" << samples.size() << " frames):" << std::endl;
+    os << "\tp50: " << percentile(0.50f) << " ms" << std::endl;
+    os << "\tp95: " << percentile(0.95f) << " ms" << std::endl;
+    os << "\tp99: " << percentile(0.99f) << " ms" << std::endl;
+    os << "\tmax: " << max() << " ms" << std::endl;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "input.hpp"
+
+// Binary input log, replaying it through Game::apply at the recorded
+// ticks reproduces the session exactly.
+//
+// Layout, little endian whatever the host order:
+//   "THRC" u16 version u64 material hash u32 seed u16 path length, path bytes
+//   per input: varint tick delta, u8 kind, payload
+//   end: varint tick delta, u8 0xff, u64 final state hash
+//   or, when the session was cut short: varint tick delta, u8 0xfe
+class Recorder {
+public:
+    ~Recorder() { if (recording()) close(last_tick); }
+
+    bool open(const std::string &path, uint32_t seed, const std::string &map_path);
+
+    void write(const Input &input);
+
+    void close(uint32_t ticks, uint64_t hash);
+
+    // Ends the log without a final state hash to check against
+    void close(uint32_t ticks);
+
+    bool recording() const { return file.is_open(); }
+
+private:
+    void put_varint(uint32_t value);
+
+    template<typename T>
+    void put(T value)
+    {
+        static_assert(std::is_arithmetic_v<T> && sizeof(T) <= sizeof(uint64_t), "replay fields are scalars");
+
+        uint64_t bits = 0;
+        if constexpr (std::is_floating_point_v<T>) {
+            static_assert(sizeof(T) == sizeof(uint32_t), "replay floats are 32 bit");
+            uint32_t raw;
+            std::memcpy(&raw, &value, sizeof(raw));
+            bits = raw;
+        } else {
+            bits = uint64_t(value);
+        }
+
+        for (size_t i = 0; i < sizeof(T); i++)
+            file.put(char(bits >> (8 * i)));
+    }
+
+    std::ofstream file;
+    uint32_t last_tick = 0;
+};
+
+// Reads a log written by Recorder, hash receives the recorded final state
+// hash and has_hash is cleared for logs that were cut short
+bool load_replay(const std::string &path, InputScript &script, uint64_t &hash, bool &has_hash);
+
+// True when the file starts with the replay magic
+bool is_replay(const std::string &path);
+
+// Per frame timings for comparing builds on the same session
+class FrameStats {
+public:
+    void add(float ms) { samples.push_back(ms); }
+
+    size_t count() const { return samples.size(); }
+
+    // Value below which the given fraction of samples fall
+    float percentile(float fraction);
+
+    float max();
+
+    void report(std::ostream &os);
+
+private:
+    std::vector<float> samples;
+};
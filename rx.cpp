@@ -0,0 +1,393 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include <SDL2/SDL.h>
+
+#include "bytes.hpp"
+#include "profile.hpp"
+#include "rx.hpp"
+#include "util.hpp"
+
+// Bump when the bytecode or its meaning changes, old caches are ignored
+static const uint16_t RX_VERSION = 1;
+static const char RX_CACHE_MAGIC[4] = { 'T', 'H', 'R', 'X' };
+
+constexpr int RX_MAX_SIZE = 256;
+
+enum RxOp : uint8_t {
+    RX_RESIZE,  // u16 w, u16 h
+    RX_COLOR,   // u8 r g b
+    RX_SEED,    // u32 seed
+    RX_FILL,    // u8 index
+    RX_RECT,    // u16 x y w h, u8 index
+    RX_PIXEL,   // u16 x y, u8 index
+    RX_NOISE,   // u8 index, u8 percent, u16 x y w h
+};
+
+bool rx_compile(const std::string &path, RxProgram &program)
+{
+    std::ifstream file(path);
+    if (!file) {
+        std::cout << "Failed to open texture script: " << path << std::endl;
+        return false;
+    }
+
+    std::string source((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    program = {};
+    program.hash = fnv1a(source.data(), source.size(), fnv1a(&RX_VERSION, sizeof(RX_VERSION)));
+
+    ByteWriter code;
+    int prelude_colors = 0, colors = 0;
+
+    auto close_texture = [&] {
+        if (program.textures.empty()) program.prelude_end = code.size();
+        else program.textures.back().end = code.size();
+    };
+
+    std::istringstream lines(source);
+    std::string line;
+    for (int number = 1; std::getline(lines, line); number++)
+    {
+        std::istringstream words(line);
+        std::string command;
+        if (!(words >> command) || command[0] == ';')
+            continue;
+
+        auto fail = [&](const char *message) {
+            std::cout << path << ":" << number << ": " << message << std::endl;
+            return false;
+        };
+
+        // Reads the remaining integer operands, optional ones keep their value
+        auto ints = [&](std::initializer_list<int *> required, std::initializer_list<int *> optional = {}) {
+            for (auto value : required)
+                if (!(words >> *value)) return false;
+            for (auto value : optional)
+                if (!(words >> *value)) break;
+            std::string extra;
+            return !(words.clear(), words >> extra);
+        };
+
+        auto index_ok = [&](int index) { return index >= 0 && index < colors; };
+
+        if (command == "f/resize") {
+            int w, h;
+            if (!ints({ &w, &h }) || w < 1 || h < 1 || w > RX_MAX_SIZE || h > RX_MAX_SIZE)
+                return fail("expected f/resize <w> <h> up to 256");
+
+            code.put(uint8_t(RX_RESIZE));
+            code.put(uint16_t(w));
+            code.put(uint16_t(h));
+        } else if (command == "p/add") {
+            std::string hex, extra;
+            unsigned rgb;
+            if (!(words >> hex) || (words >> extra) || hex.size() != 7 || hex[0] != '#'
+                || std::sscanf(hex.c_str() + 1, "%6x", &rgb) != 1 || colors == 255)
+                return fail("expected p/add #rrggbb");
+
+            code.put(uint8_t(RX_COLOR));
+            code.put(uint8_t(rgb >> 16));
+            code.put(uint8_t(rgb >> 8));
+            code.put(uint8_t(rgb));
+            colors++;
+        } else if (command == "r/seed") {
+            int seed;
+            if (!ints({ &seed }))
+                return fail("expected r/seed <n>");
+
+            code.put(uint8_t(RX_SEED));
+            code.put(uint32_t(seed));
+        } else if (command == "t/begin") {
+            std::string name;
+            int variants = 1;
+            if (!(words >> name) || !ints({}, { &variants }) || variants < 1 || variants > 255)
+                return fail("expected t/begin <name> [variants]");
+
+            close_texture();
+            if (program.textures.empty()) prelude_colors = colors;
+            colors = prelude_colors;
+            program.textures.push_back({ name, uint16_t(variants), uint32_t(code.size()), 0 });
+        } else if (command == "d/fill") {
+            int index;
+            if (!ints({ &index }) || !index_ok(index))
+                return fail("expected d/fill <palette index>");
+
+            code.put(uint8_t(RX_FILL));
+            code.put(uint8_t(index));
+        } else if (command == "d/rect") {
+            int x, y, w, h, index;
+            if (!ints({ &x, &y, &w, &h, &index }) || !index_ok(index) || x < 0 || y < 0 || w < 0 || h < 0)
+                return fail("expected d/rect <x> <y> <w> <h> <palette index>");
+
+            code.put(uint8_t(RX_RECT));
+            for (int value : { x, y, w, h }) code.put(uint16_t(std::min(value, RX_MAX_SIZE)));
+            code.put(uint8_t(index));
+        } else if (command == "d/pixel") {
+            int x, y, index;
+            if (!ints({ &x, &y, &index }) || !index_ok(index) || x < 0 || y < 0)
+                return fail("expected d/pixel <x> <y> <palette index>");
+
+            code.put(uint8_t(RX_PIXEL));
+            code.put(uint16_t(std::min(x, RX_MAX_SIZE)));
+            code.put(uint16_t(std::min(y, RX_MAX_SIZE)));
+            code.put(uint8_t(index));
+        } else if (command == "d/noise") {
+            // Without a region it covers the canvas, put() clips to it
+            int index, percent, x = 0, y = 0, w = RX_MAX_SIZE, h = RX_MAX_SIZE;
+            if (!ints({ &index, &percent }, { &x, &y, &w, &h }) || !index_ok(index)
+                || percent < 0 || percent > 100 || x < 0 || y < 0 || w < 0 || h < 0)
+                return fail("expected d/noise <palette index> <percent> [x y w h]");
+
+            code.put(uint8_t(RX_NOISE));
+            code.put(uint8_t(index));
+            code.put(uint8_t(percent));
+            for (int value : { x, y, w, h }) code.put(uint16_t(std::min(value, RX_MAX_SIZE)));
+        } else {
+            return fail("unknown command");
+        }
+    }
+
+    close_texture();
+    program.code = std::move(code.bytes);
+    return true;
+}
+
+struct RxState {
+    int width = 8;
+    int height = 8;
+    std::vector<uint32_t> palette;
+    std::vector<uint8_t> pixels = std::vector<uint8_t>(8 * 8 * 4);
+    std::mt19937 rng;
+    int variant;
+
+    void put(int x, int y, uint8_t index)
+    {
+        if (x >= width || y >= height) return;
+        uint32_t rgba = palette[index];
+        std::memcpy(&pixels[(y * width + x) * 4], &rgba, 4);
+    }
+};
+
+// Operands were checked when compiling, the code cannot be truncated
+static void execute(RxState &state, const uint8_t *begin, const uint8_t *end)
+{
+    ByteReader code = { begin, end };
+    uint8_t op, index = 0, percent = 0;
+    uint16_t x = 0, y = 0, w = 0, h = 0;
+
+    while (code.get(op))
+    {
+        switch (op)
+        {
+            case RX_RESIZE:
+                code.get(w);
+                code.get(h);
+                state.width = w;
+                state.height = h;
+                state.pixels.assign(w * h * 4, 0);
+                break;
+
+            case RX_COLOR: {
+                uint8_t rgba[4] = { 0, 0, 0, 255 };
+                code.get_bytes(rgba, 3);
+                uint32_t color;
+                std::memcpy(&color, rgba, 4);
+                state.palette.push_back(color);
+                break;
+            }
+
+            case RX_SEED: {
+                uint32_t seed = 0;
+                code.get(seed);
+                state.rng.seed(seed + state.variant);
+                break;
+            }
+
+            case RX_FILL:
+                code.get(index);
+                for (int py = 0; py < state.height; py++)
+                    for (int px = 0; px < state.width; px++)
+                        state.put(px, py, index);
+                break;
+
+            case RX_RECT:
+                code.get(x); code.get(y); code.get(w); code.get(h);
+                code.get(index);
+                for (int py = y; py < y + h; py++)
+                    for (int px = x; px < x + w; px++)
+                        state.put(px, py, index);
+                break;
+
+            case RX_PIXEL:
+                code.get(x); code.get(y);
+                code.get(index);
+                state.put(x, y, index);
+                break;
+
+            case RX_NOISE: {
+                code.get(index); code.get(percent);
+                code.get(x); code.get(y); code.get(w); code.get(h);
+                std::uniform_int_distribution<int> roll(0, 99);
+                for (int py = y; py < y + h; py++)
+                    for (int px = x; px < x + w; px++)
+                        if (roll(state.rng) < percent)
+                            state.put(px, py, index);
+                break;
+            }
+        }
+    }
+}
+
+static RxImage render(const RxProgram &program, const RxProgram::Texture &texture, uint16_t variant)
+{
+    RxState state;
+    state.variant = variant;
+    state.rng.seed(variant);
+
+    const uint8_t *code = program.code.data();
+    execute(state, code, code + program.prelude_end);
+    execute(state, code + texture.begin, code + texture.end);
+
+    return {
+        .name = texture.name,
+        .variant = variant,
+        .width = uint16_t(state.width),
+        .height = uint16_t(state.height),
+        .pixels = std::move(state.pixels),
+    };
+}
+
+static std::string cache_path(const RxProgram &program, const std::string &cache_dir)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.rxc", (unsigned long long)program.hash);
+    return cache_dir + "/" + name;
+}
+
+static bool load_cache(const std::string &path, std::vector<RxImage> &images)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ByteReader in = { bytes.data(), bytes.data() + bytes.size() };
+
+    char magic[sizeof(RX_CACHE_MAGIC)];
+    uint16_t version;
+    uint32_t count;
+    if (!in.get_bytes(magic, sizeof(magic)) || std::memcmp(magic, RX_CACHE_MAGIC, sizeof(magic)) != 0
+        || !in.get(version) || version != RX_VERSION || !in.get(count))
+        return false;
+
+    // Every image takes at least its name length, variant and size, a
+    // count the file cannot hold is corrupt
+    constexpr size_t IMAGE_HEADER = 4 * sizeof(uint16_t);
+    if (count > size_t(in.end - in.at) / IMAGE_HEADER)
+        return false;
+
+    images.resize(count);
+    for (auto &image : images) {
+        uint16_t name_len;
+        if (!in.get(name_len))
+            return false;
+
+        image.name.resize(name_len);
+        if (!in.get_bytes(image.name.data(), name_len) || !in.get(image.variant)
+            || !in.get(image.width) || !in.get(image.height))
+            return false;
+
+        // Sizes the scripts could never produce, or pixels past the end
+        size_t size = size_t(image.width) * image.height * 4;
+        if (image.width < 1 || image.height < 1 || image.width > RX_MAX_SIZE || image.height > RX_MAX_SIZE
+            || size > size_t(in.end - in.at))
+            return false;
+
+        image.pixels.resize(size);
+        if (!in.get_bytes(image.pixels.data(), image.pixels.size()))
+            return false;
+    }
+
+    return true;
+}
+
+static void save_cache(const std::string &path, const std::vector<RxImage> &images)
+{
+    ByteWriter out;
+    out.put_bytes(RX_CACHE_MAGIC, sizeof(RX_CACHE_MAGIC));
+    out.put(RX_VERSION);
+    out.put(uint32_t(images.size()));
+
+    for (auto &image : images) {
+        out.put(uint16_t(image.name.size()));
+        out.put_bytes(image.name.data(), image.name.size());
+        out.put(image.variant);
+        out.put(image.width);
+        out.put(image.height);
+        out.put_bytes(image.pixels.data(), image.pixels.size());
+    }
+
+    // Written aside and renamed, a second instance never reads half a file
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char *>(out.bytes.data()), out.size())) {
+            std::cout << "Failed to write texture cache: " << temp << std::endl;
+            return;
+        }
+    }
+    std::rename(temp.c_str(), path.c_str());
+}
+
+std::vector<RxImage> rx_build(const RxProgram &program, const std::string &cache_dir)
+{
+    PROFILE_ZONE("rx_build");
+
+    auto start = SDL_GetPerformanceCounter();
+    auto elapsed_ms = [&] {
+        return (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+    };
+
+    std::vector<RxImage> images;
+    std::string path = cache_path(program, cache_dir);
+    if (load_cache(path, images)) {
+        std::cout << "Loaded " << images.size() << " textures from " << path
+                  << " in " << elapsed_ms() << " ms" << std::endl;
+        return images;
+    }
+
+    // One job per variant, spread over the cores
+    std::vector<std::pair<const RxProgram::Texture *, uint16_t>> jobs;
+    for (auto &texture : program.textures)
+        for (uint16_t variant = 0; variant < texture.variants; variant++)
+            jobs.push_back({ &texture, variant });
+
+    images.resize(jobs.size());
+    std::atomic<size_t> next = 0;
+    auto work = [&] {
+        for (size_t job; (job = next++) < jobs.size();)
+            images[job] = render(program, *jobs[job].first, jobs[job].second);
+    };
+
+    size_t thread_count = std::min<size_t>(jobs.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; i++)
+        threads.emplace_back(work);
+    work();
+    for (auto &thread : threads)
+        thread.join();
+
+    std::cout << "Generated " << images.size() << " textures in " << elapsed_ms() << " ms" << std::endl;
+
+    std::error_code error;
+    std::filesystem::create_directories(cache_dir, error);
+    if (!error) save_cache(path, images);
+    return images;
+}
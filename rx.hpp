@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Texture scripts, one command per line:
+//   f/resize <w> <h>            canvas size, clears it
+//   p/add #rrggbb               append a colour to the palette
+//   r/seed <n>                  noise seed, variants add their index
+//   t/begin <name> [variants]   start a texture, until the next t/begin
+//   d/fill <i>                  whole canvas with palette colour i
+//   d/rect <x> <y> <w> <h> <i>
+//   d/pixel <x> <y> <i>
+//   d/noise <i> <percent> [x y w h]   random pixels of colour i
+// Commands before the first t/begin are shared by every texture.
+
+// Script compiled to bytecode, u8 opcode then fixed size operands
+struct RxProgram {
+    struct Texture {
+        std::string name;
+        uint16_t variants;
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    std::vector<uint8_t> code;
+    uint32_t prelude_end = 0;
+    std::vector<Texture> textures;
+    // Of the script source, keys the cache
+    uint64_t hash = 0;
+};
+
+struct RxImage {
+    std::string name;
+    uint16_t variant;
+    uint16_t width;
+    uint16_t height;
+    // RGBA32
+    std::vector<uint8_t> pixels;
+};
+
+bool rx_compile(const std::string &path, RxProgram &program);
+
+// Every variant of every texture, rendered in parallel or read from the
+// cache when the script has not changed since the last run
+std::vector<RxImage> rx_build(const RxProgram &program, const std::string &cache_dir);
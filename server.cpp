@@ -0,0 +1,333 @@
+#include <algorithm>
+#include <iostream>
+
+#include "game.hpp"
+#include "profile.hpp"
+#include "server.hpp"
+
+// Snapshots go out at 60 Hz, half the simulation rate
+constexpr uint32_t SNAPSHOT_TICKS = 2;
+
+// Bound on what one client can ask to see, in tiles
+constexpr int MAX_VIEW_WIDTH = 96;
+constexpr int MAX_VIEW_HEIGHT = 54;
+
+// Players this close outside the view are sent too, in tiles
+constexpr float VIEW_MARGIN = 4.0f;
+
+// Share of a snapshot for players, chunks get the rest
+constexpr size_t THING_BUDGET = NET_MTU / 2;
+
+// Resend an unacknowledged chunk after this many snapshots
+constexpr uint32_t CHUNK_RESEND = 8;
+
+// Commands queued past this are dropped, bounds the input delay
+constexpr size_t MAX_QUEUED_COMMANDS = 16;
+
+bool Server::open(uint16_t port, const std::string &map_path, bool loopback)
+{
+    map.init(nullptr);
+    if (!map.load_file(map_path)) {
+        std::cout << "Failed to load map: " << map_path << std::endl;
+        return false;
+    }
+
+    map.clear_dirty(D_ALL);
+    chunk_version.assign(map.chunk_count(), 0);
+    return socket.open(port, loopback);
+}
+
+Server::Peer *Server::find(const NetAddress &address)
+{
+    for (auto &peer : peers)
+        if (peer.address == address)
+            return &peer;
+    return nullptr;
+}
+
+void Server::tick()
+{
+    PROFILE_ZONE("Server::tick");
+
+    receive();
+
+    // Clients a bit behind catch up with a second command this tick
+    for (auto &peer : peers) {
+        size_t steps = peer.commands.size() > 2 ? 2 : peer.commands.size();
+        for (size_t i = 0; i < steps; i++) {
+            simulate(peer, peer.commands.front());
+            peer.commands.pop_front();
+        }
+    }
+
+    for (auto chunk : map.dirty_chunks())
+        if (map.chunk_dirty(chunk) & D_RENDER)
+            chunk_version[chunk] = ticks;
+    map.clear_dirty(D_ALL);
+
+    peers.erase(std::remove_if(peers.begin(), peers.end(), [&](const Peer &peer) {
+        bool timed_out = ticks - peer.last_heard > NET_TIMEOUT_TICKS;
+        if (timed_out)
+            std::cout << "Player " << peer.id << " timed out" << std::endl;
+        return timed_out;
+    }), peers.end());
+
+    // Nothing is sent until the client shows it is ready with a command
+    if (ticks % SNAPSHOT_TICKS == 0)
+        for (auto &peer : peers)
+            if (peer.queued_seq > 0)
+                send_snapshot(peer);
+
+    ticks++;
+}
+
+void Server::receive()
+{
+    uint8_t buffer[2048];
+    NetAddress from;
+
+    while (size_t len = socket.receive(from, buffer, sizeof(buffer)))
+    {
+        ByteReader packet = { buffer, buffer + len };
+        PacketKind kind;
+        if (!get_header(packet, kind))
+            continue;
+
+        Peer *peer = find(from);
+        if (peer) peer->last_heard = ticks;
+
+        switch (kind)
+        {
+            case P_CONNECT:
+                if (!peer) {
+                    Peer &added = peers.emplace_back();
+                    added.address = from;
+                    added.id = next_id++;
+                    added.last_heard = ticks;
+                    added.thing.init(nullptr, 1.0f);
+                    added.thing.spawn(map.spawn());
+                    added.chunk_known.assign(map.chunk_count(), 0);
+                    added.chunk_sent_version.assign(map.chunk_count(), 0);
+                    added.chunk_sent_at.assign(map.chunk_count(), 0);
+                    peer = &added;
+                    std::cout << "Player " << peer->id << " joined from " << from.str() << std::endl;
+                }
+
+                // Resent for every connect, the previous welcome may be lost
+                send_welcome(*peer);
+                break;
+
+            case P_COMMANDS:
+                if (peer) handle_commands(*peer, packet);
+                break;
+
+            case P_DISCONNECT:
+                if (peer) {
+                    std::cout << "Player " << peer->id << " left" << std::endl;
+                    peers.erase(peers.begin() + (peer - peers.data()));
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+void Server::handle_commands(Peer &peer, ByteReader &packet)
+{
+    uint32_t acked, count;
+    if (!packet.get(acked) || !packet.get_bytes(peer.view, sizeof(peer.view)) || !packet.get_varint(count))
+        return;
+
+    // Everything the client decoded from that snapshot is now known to it
+    Sent &sent = peer.sent[acked % SENT_HISTORY];
+    if (acked > peer.acked && sent.id == acked) {
+        peer.acked = acked;
+        for (auto [chunk, version] : sent.chunks)
+            peer.chunk_known[chunk] = std::max(peer.chunk_known[chunk], version);
+    }
+
+    // Commands are resent until processed, only new ones are queued
+    for (uint32_t i = 0; i < count; i++) {
+        Command command;
+        if (!get_command(packet, command))
+            return;
+
+        if (command.seq <= peer.queued_seq)
+            continue;
+
+        peer.queued_seq = command.seq;
+        peer.commands.push_back(command);
+        if (peer.commands.size() > MAX_QUEUED_COMMANDS)
+            peer.commands.pop_front();
+    }
+}
+
+void Server::simulate(Peer &peer, const Command &command)
+{
+    for (auto &edit : Slice(command.edits, command.edit_count)) {
+        // Solid tiles may not be placed inside any player
+        FixedRect rect = FixedRect::tile(edit.column, edit.row);
+        bool blocked = material_solid(edit.material) && std::any_of(peers.begin(), peers.end(), [&](const Peer &other) {
+            auto &thing = other.thing.collider.rect;
+            return rect.x < thing.x + thing.w && thing.x < rect.x + rect.w
+                && rect.y < thing.y + thing.h && thing.y < rect.y + rect.h;
+        });
+
+        if (!blocked)
+            map.set_tile(edit.row, edit.column, edit.material);
+        else if (edit.row < map.height() && edit.column < map.width())
+            // The client already predicted the edit, resending the chunk undoes it
+            chunk_version[map.chunk_index(edit.row, edit.column)] = ticks;
+    }
+
+    apply_command(peer.thing, command);
+
+    Tile tiles[8];
+    step_thing(peer.thing, map, TICK_MS, tiles);
+    peer.processed_seq = command.seq;
+}
+
+void Server::send_welcome(const Peer &peer)
+{
+    ByteWriter packet;
+    put_header(packet, P_WELCOME);
+    packet.put(peer.id);
+    packet.put(material_hash());
+    packet.put(uint16_t(map.file_path().size()));
+    packet.put_bytes(map.file_path().data(), map.file_path().size());
+    socket.send(peer.address, packet);
+}
+
+void Server::send_snapshot(Peer &peer)
+{
+    uint32_t id = peer.next_snapshot++;
+    const Sent &acked = peer.sent[peer.acked % SENT_HISTORY];
+    bool has_base = peer.acked != 0 && acked.id == peer.acked;
+
+    static const Sent EMPTY;
+    const Sent &base = has_base ? acked : EMPTY;
+
+    // Built aside, the slot may still hold the baseline
+    Sent next;
+    next.id = id;
+
+    // Interest area around the client camera
+    float width = std::min<float>(peer.view[2], MAX_VIEW_WIDTH);
+    float height = std::min<float>(peer.view[3], MAX_VIEW_HEIGHT);
+    WorldPos centre = WorldPos::tile(peer.view[0], peer.view[1]);
+    centre.x += to_fixed(peer.view[2] * 0.5f);
+    centre.y += to_fixed(peer.view[3] * 0.5f);
+
+    // Nearest players first, the budget cuts off the far ones
+    std::vector<std::pair<float, const Peer *>> visible;
+    for (auto &other : peers) {
+        auto [x, y] = other.thing.centre().minus(centre);
+        bool inside = std::abs(x) <= width * 0.5f + VIEW_MARGIN && std::abs(y) <= height * 0.5f + VIEW_MARGIN;
+        if (&other == &peer || inside)
+            visible.push_back({ &other == &peer ? -1.0f : x * x + y * y, &other });
+    }
+    std::sort(visible.begin(), visible.end(), [](auto &a, auto &b) { return a.first < b.first; });
+
+    auto find_base = [&](uint16_t player) -> const ThingState * {
+        auto it = std::lower_bound(base.things.begin(), base.things.end(), player,
+                                   [](auto &entry, uint16_t id) { return entry.first < id; });
+        return it != base.things.end() && it->first == player ? &it->second : nullptr;
+    };
+
+    ByteWriter things;
+    uint32_t changed = 0;
+    for (auto [distance, other] : visible) {
+        const ThingState *previous = find_base(other->id);
+        ThingState state = other->thing.state();
+
+        ByteWriter delta;
+        delta.put_varint(other->id);
+        uint8_t mask = put_thing_delta(delta, previous ? *previous : ThingState{}, state);
+
+        if (previous && mask == 0) {
+            next.things.push_back({ other->id, *previous });
+        } else if (things.size() + delta.size() <= THING_BUDGET || other == &peer) {
+            things.put_bytes(delta.bytes.data(), delta.size());
+            next.things.push_back({ other->id, state });
+            changed++;
+        } else if (previous) {
+            next.things.push_back({ other->id, *previous });
+        }
+    }
+    std::sort(next.things.begin(), next.things.end(), [](auto &a, auto &b) { return a.first < b.first; });
+
+    ByteWriter packet;
+    put_header(packet, P_SNAPSHOT);
+    packet.put(id);
+    packet.put(has_base ? base.id : uint32_t(0));
+    packet.put(peer.processed_seq);
+
+    // Players in the baseline that left the view or the game
+    std::vector<uint16_t> removed;
+    for (auto &[player, state] : base.things) {
+        bool kept = std::binary_search(next.things.begin(), next.things.end(), std::make_pair(player, ThingState{}),
+                                       [](auto &a, auto &b) { return a.first < b.first; });
+        if (!kept) removed.push_back(player);
+    }
+    packet.put_varint(removed.size());
+    for (auto player : removed)
+        packet.put_varint(player);
+
+    packet.put_varint(changed);
+    packet.put_bytes(things.bytes.data(), things.size());
+
+    // Chunks in view the client has not acknowledged, nearest first
+    int64_t left = (centre.x + to_fixed(-width * 0.5f)).tile();
+    int64_t top = (centre.y + to_fixed(-height * 0.5f)).tile();
+    int64_t right = (centre.x + to_fixed(width * 0.5f)).tile();
+    int64_t bottom = (centre.y + to_fixed(height * 0.5f)).tile();
+    int column0 = int(std::max<int64_t>(0, left / CHUNK_SIZE));
+    int row0 = int(std::max<int64_t>(0, top / CHUNK_SIZE));
+    int column1 = int(std::min<int64_t>(map.chunks_x() - 1, right / CHUNK_SIZE));
+    int row1 = int(std::min<int64_t>(map.chunk_count() / std::max<size_t>(1, map.chunks_x()) - 1, bottom / CHUNK_SIZE));
+
+    std::vector<std::pair<float, uint32_t>> wanted;
+    for (int row = row0; row <= row1; row++) {
+        for (int column = column0; column <= column1; column++) {
+            uint32_t chunk = row * map.chunks_x() + column;
+            uint32_t version = chunk_version[chunk];
+            if (version <= peer.chunk_known[chunk]) continue;
+            if (version <= peer.chunk_sent_version[chunk] && id - peer.chunk_sent_at[chunk] < CHUNK_RESEND) continue;
+
+            auto [x, y] = WorldPos::tile(column * CHUNK_SIZE + CHUNK_SIZE / 2, row * CHUNK_SIZE + CHUNK_SIZE / 2).minus(centre);
+            wanted.push_back({ x * x + y * y, chunk });
+        }
+    }
+    std::sort(wanted.begin(), wanted.end());
+
+    ByteWriter chunks;
+    Material tiles[CHUNK_SIZE * CHUNK_SIZE];
+    Material source[CHUNK_SIZE * CHUNK_SIZE];
+    uint8_t delta[CHUNK_SIZE * CHUNK_SIZE];
+    size_t budget = NET_MTU > packet.size() + 8 ? NET_MTU - packet.size() - 8 : 0;
+
+    for (auto [distance, chunk] : wanted) {
+        map.chunk_tiles(chunk, tiles);
+        map.chunk_source(chunk, source);
+        for (size_t i = 0; i < std::size(delta); i++)
+            delta[i] = uint8_t(tiles[i] ^ source[i]);
+
+        ByteWriter encoded;
+        encoded.put_varint(chunk);
+        encoded.put_runs(delta, std::size(delta));
+        if (chunks.size() + encoded.size() > budget) continue;
+
+        chunks.put_bytes(encoded.bytes.data(), encoded.size());
+        next.chunks.push_back({ chunk, chunk_version[chunk] });
+        peer.chunk_sent_version[chunk] = chunk_version[chunk];
+        peer.chunk_sent_at[chunk] = id;
+    }
+
+    packet.put_varint(next.chunks.size());
+    packet.put_bytes(chunks.bytes.data(), chunks.size());
+
+    peer.sent[id % SENT_HISTORY] = std::move(next);
+    socket.send(peer.address, packet);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "map.hpp"
+#include "net.hpp"
+#include "thing.hpp"
+
+// Authoritative simulation for networked players, runs headless. Each
+// player steps once per command it sent, the same way the client predicts.
+class Server {
+public:
+    // Loopback only accepts clients on this machine, used by the soak test
+    bool open(uint16_t port, const std::string &map_path, bool loopback);
+
+    // Receive commands, simulate and send snapshots
+    void tick();
+
+    uint16_t port() const { return socket.port(); }
+
+    size_t players() const { return peers.size(); }
+
+    const Socket &traffic() const { return socket; }
+
+private:
+    // What a client holds after decoding one snapshot
+    struct Sent {
+        uint32_t id = 0;
+        // Sorted by player id
+        std::vector<std::pair<uint16_t, ThingState>> things;
+        // Chunk index and the version it carried
+        std::vector<std::pair<uint32_t, uint32_t>> chunks;
+    };
+
+    static constexpr size_t SENT_HISTORY = 32;
+
+    struct Peer {
+        NetAddress address;
+        uint16_t id;
+        Thing thing;
+        std::deque<Command> commands;
+        uint32_t queued_seq = 0;
+        uint32_t processed_seq = 0;
+        uint32_t last_heard = 0;
+        // Camera in tiles, clamped before use
+        uint32_t view[4] = {};
+
+        uint32_t next_snapshot = 1;
+        uint32_t acked = 0;
+        std::array<Sent, SENT_HISTORY> sent;
+        // Per chunk: version the client acked, version and snapshot last sent
+        std::vector<uint32_t> chunk_known;
+        std::vector<uint32_t> chunk_sent_version;
+        std::vector<uint32_t> chunk_sent_at;
+    };
+
+    void receive();
+
+    void handle_commands(Peer &peer, ByteReader &packet);
+
+    void simulate(Peer &peer, const Command &command);
+
+    void send_welcome(const Peer &peer);
+
+    void send_snapshot(Peer &peer);
+
+    Peer *find(const NetAddress &address);
+
+    Socket socket;
+    Map map;
+    uint32_t ticks = 1;
+    uint16_t next_id = 1;
+    std::vector<Peer> peers;
+    // Tick of the last change to each chunk, 0 for tiles as loaded
+    std::vector<uint32_t> chunk_version;
+};
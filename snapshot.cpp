@@ -0,0 +1,209 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "bytes.hpp"
+#include "snapshot.hpp"
+#include "profile.hpp"
+
+static const char SNAPSHOT_MAGIC[4] = { 'T', 'H', 'S', 'N' };
+static const uint16_t SNAPSHOT_VERSION = 6;
+
+static void encode(ByteWriter &out, const Snapshot &snapshot)
+{
+    out.put_bytes(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    out.put(SNAPSHOT_VERSION);
+    out.put(material_hash());
+    out.put(uint16_t(snapshot.map_path.size()));
+    out.put_bytes(snapshot.map_path.data(), snapshot.map_path.size());
+    out.put(snapshot.map_width);
+    out.put(snapshot.map_height);
+    out.put(snapshot.tick);
+    out.put(snapshot.rng);
+    out.put(snapshot.thing.pos);
+    out.put(snapshot.thing.vel);
+    out.put(snapshot.thing.accel);
+    out.put(snapshot.thing.landing);
+    out.put(uint8_t(snapshot.thing.facing));
+    out.put(uint8_t(snapshot.thing.on_ground));
+    out.put(uint8_t(snapshot.thing.ground));
+    out.put(snapshot.camera);
+    out.put(snapshot.zoom);
+    out.put(uint8_t(snapshot.stress));
+
+    out.put_varint(snapshot.chunks.size() + snapshot.captured.size());
+    for (auto &delta : snapshot.chunks) {
+        out.put_varint(delta.chunk);
+
+        // Edits are sparse, most of a delta is runs of zero
+        out.put_runs(delta.tiles.data(), delta.tiles.size());
+    }
+
+    uint8_t current[CHUNK_SIZE * CHUNK_SIZE];
+    uint8_t loaded[CHUNK_SIZE * CHUNK_SIZE];
+    for (auto &capture : snapshot.captured) {
+        capture.current.decode(current);
+        capture.loaded.decode(loaded);
+        for (size_t i = 0; i < CHUNK_SIZE * CHUNK_SIZE; i++)
+            current[i] ^= loaded[i];
+
+        out.put_varint(capture.chunk);
+        out.put_runs(current, CHUNK_SIZE * CHUNK_SIZE);
+    }
+}
+
+bool save_snapshot(const std::string &path, const Snapshot &snapshot, size_t *size)
+{
+    ByteWriter out;
+    encode(out, snapshot);
+
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file.write(reinterpret_cast<const char *>(out.bytes.data()), out.bytes.size()))
+            return false;
+    }
+
+    if (std::rename(temp.c_str(), path.c_str()) != 0)
+        return false;
+
+    if (size) *size = out.bytes.size();
+    return true;
+}
+
+bool load_snapshot(const std::string &path, Snapshot &snapshot)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cout << "Failed to open snapshot: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ByteReader in = { bytes.data(), bytes.data() + bytes.size() };
+
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    uint16_t version, path_len;
+    if (!in.get_bytes(magic, sizeof(magic)) || std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0) {
+        std::cout << "Invalid snapshot header" << std::endl;
+        return false;
+    }
+
+    if (!in.get(version) || version != SNAPSHOT_VERSION) {
+        std::cout << "Unsupported snapshot version" << std::endl;
+        return false;
+    }
+
+    uint64_t materials;
+    if (!in.get(materials) || materials != material_hash()) {
+        std::cout << "Snapshot was saved with different materials" << std::endl;
+        return false;
+    }
+
+    uint32_t chunk_count = 0;
+    uint8_t facing = 0, on_ground = 0, ground = 0, stress = 0;
+    bool ok = in.get(path_len);
+    if (ok) {
+        snapshot.map_path.resize(path_len);
+        ok = in.get_bytes(snapshot.map_path.data(), path_len);
+    }
+    ok = ok && in.get(snapshot.map_width) && in.get(snapshot.map_height)
+        && in.get(snapshot.tick) && in.get(snapshot.rng);
+    ok = ok && in.get(snapshot.thing.pos) && in.get(snapshot.thing.vel)
+        && in.get(snapshot.thing.accel) && in.get(snapshot.thing.landing)
+        && in.get(facing) && in.get(on_ground) && in.get(ground) && ground < M_COUNT && in.get(snapshot.camera)
+        && in.get(snapshot.zoom) && in.get(stress) && in.get_varint(chunk_count);
+
+    snapshot.thing.facing = facing ? F_RIGHT : F_LEFT;
+    snapshot.thing.on_ground = on_ground;
+    snapshot.thing.ground = Material(ground);
+    snapshot.stress = stress;
+    snapshot.chunks.clear();
+    snapshot.captured.clear();
+
+    for (uint32_t c = 0; ok && c < chunk_count; c++) {
+        ChunkDelta delta;
+        ok = in.get_varint(delta.chunk) && in.get_runs(delta.tiles.data(), delta.tiles.size());
+
+        if (ok) snapshot.chunks.push_back(delta);
+    }
+
+    if (!ok) {
+        std::cout << "Truncated snapshot: " << path << std::endl;
+        return false;
+    }
+
+    // These reach the float to int conversions of culling and the LOD
+    auto finite = [](Vec2<float> v) { return std::isfinite(v.x) && std::isfinite(v.y); };
+    if (!snapshot.thing.pos.valid() || !snapshot.thing.landing.valid() || !snapshot.camera.valid()
+        || !finite(snapshot.thing.vel) || !finite(snapshot.thing.accel)
+        || !std::isfinite(snapshot.zoom) || snapshot.zoom <= 0.0f) {
+        std::cout << "Invalid state in snapshot: " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+SnapshotWriter::SnapshotWriter()
+{
+    worker = std::thread(&SnapshotWriter::run, this);
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void SnapshotWriter::save(const std::string &path, Snapshot &&snapshot)
+{
+    {
+        std::lock_guard lock(mutex);
+        this->path = path;
+        queued = std::move(snapshot);
+        pending = true;
+    }
+    wake.notify_one();
+}
+
+void SnapshotWriter::run()
+{
+    while (true)
+    {
+        std::string path;
+        Snapshot snapshot;
+        {
+            std::unique_lock lock(mutex);
+            wake.wait(lock, [&] { return stopping || pending; });
+
+            // Pending saves still finish on shutdown
+            if (!pending) return;
+
+            path = std::move(this->path);
+            snapshot = std::move(queued);
+            writing = true;
+            pending = false;
+        }
+
+        PROFILE_ZONE("SnapshotWriter::save");
+
+        auto start = SDL_GetPerformanceCounter();
+        size_t bytes = 0;
+        if (save_snapshot(path, snapshot, &bytes)) {
+            write_ms = (SDL_GetPerformanceCounter() - start) * 1000.0f / SDL_GetPerformanceFrequency();
+            size = bytes;
+        } else {
+            std::cout << "Failed to write snapshot: " << path << std::endl;
+        }
+
+        writing = false;
+    }
+}
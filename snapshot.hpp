@@ -0,0 +1,92 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "map.hpp"
+#include "thing.hpp"
+
+// A modified chunk, XORed against the tiles loaded from the map file so
+// untouched tiles in it become zero runs
+struct ChunkDelta {
+    uint32_t chunk;
+    std::array<uint8_t, CHUNK_SIZE * CHUNK_SIZE> tiles;
+};
+
+// A modified chunk as captured, still packed. It is diffed into a
+// ChunkDelta when the snapshot is encoded, on the saver thread.
+struct ChunkCapture {
+    uint32_t chunk;
+    PackedCopy current;
+    PackedCopy loaded;
+};
+
+// Game state on top of the map file it was captured from. Chunks never
+// edited are shared with the map file and not stored at all.
+struct Snapshot {
+    std::string map_path;
+    uint32_t map_width = 0;
+    uint32_t map_height = 0;
+    uint32_t tick = 0;
+    // SplitMix64 state
+    uint64_t rng = 0;
+    ThingState thing{};
+    // Top left, its size follows from the zoom and the window
+    WorldPos camera{};
+    float zoom = 1.0f;
+    bool stress = false;
+    // As loaded from a file
+    std::vector<ChunkDelta> chunks;
+    // As taken by Game::capture, saved as deltas
+    std::vector<ChunkCapture> captured;
+};
+
+// Layout, little endian:
+//   "THSN" u16 version, u64 material hash, u16 path length, path bytes
+//   u32 width u32 height u32 tick, u64 rng
+//   thing pos vel accel landing, u8 facing u8 on_ground u8 ground
+//   camera, zoom, u8 stress
+//   varint chunk count, per chunk: varint index, then varint length,
+//   u8 value runs covering the CHUNK_SIZE² delta bytes
+bool save_snapshot(const std::string &path, const Snapshot &snapshot, size_t *size = nullptr);
+
+bool load_snapshot(const std::string &path, Snapshot &snapshot);
+
+// Encodes and writes snapshots off the main thread. Files are written
+// next to their target and renamed, a crash never leaves half a save.
+class SnapshotWriter {
+public:
+    SnapshotWriter();
+
+    ~SnapshotWriter();
+
+    // Replaces a queued save that has not started yet
+    void save(const std::string &path, Snapshot &&snapshot);
+
+    bool busy() const { return pending || writing; }
+
+    float last_write_ms() const { return write_ms; }
+
+    size_t last_size() const { return size; }
+
+private:
+    void run();
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::string path;
+    Snapshot queued;
+    std::atomic<bool> pending = false;
+    std::atomic<bool> writing = false;
+    std::atomic<float> write_ms = 0.0f;
+    std::atomic<size_t> size = 0;
+};
@@ -0,0 +1,168 @@
+#include <algorithm>
+
+#include "profile.hpp"
+#include "tasks.hpp"
+#include "util.hpp"
+
+// A frame has only a handful of tasks worth spreading
+constexpr unsigned MAX_WORKERS = 7;
+
+unsigned WorkerPool::default_threads()
+{
+    unsigned cores = std::thread::hardware_concurrency();
+    return std::min(MAX_WORKERS, cores > 1 ? cores - 1 : 0);
+}
+
+WorkerPool::WorkerPool(unsigned threads)
+{
+    for (unsigned i = 0; i < threads; i++)
+        workers.emplace_back(&WorkerPool::run, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void WorkerPool::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+bool WorkerPool::run_one()
+{
+    std::function<void()> job;
+    {
+        std::lock_guard lock(mutex);
+        if (jobs.empty()) return false;
+
+        job = std::move(jobs.front());
+        jobs.pop_front();
+    }
+
+    job();
+    return true;
+}
+
+void WorkerPool::run()
+{
+    for (;;)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock lock(mutex);
+            wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) return;
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        job();
+    }
+}
+
+TaskGraph::Task TaskGraph::add(const char *name, std::function<void()> work, std::initializer_list<Task> after, bool main_thread)
+{
+    Task task = nodes.size();
+    nodes.push_back({ name, std::move(work), {}, 0, main_thread });
+    for (auto on : after)
+        depend(task, on);
+    return task;
+}
+
+TaskGraph::Task TaskGraph::add(const char *name, std::function<void()> work, const std::vector<Task> &after, bool main_thread)
+{
+    Task task = nodes.size();
+    nodes.push_back({ name, std::move(work), {}, 0, main_thread });
+    for (auto on : after)
+        depend(task, on);
+    return task;
+}
+
+void TaskGraph::depend(Task task, Task on)
+{
+    if (on >= task)
+        panic("Task depends on one added after it");
+
+    nodes[on].dependents.push_back(task);
+    nodes[task].waiting++;
+}
+
+void TaskGraph::run(WorkerPool *pool)
+{
+    if (pool == nullptr || pool->threads() == 0) {
+        for (auto &node : nodes) {
+            PROFILE_ZONE(node.name);
+            node.work();
+        }
+        return;
+    }
+
+    std::unique_lock lock(mutex);
+    remaining = nodes.size();
+    main_ready.clear();
+
+    // Workers may finish and release tasks while these are handed out
+    std::vector<Task> ready;
+    for (Task task = 0; task < nodes.size(); task++)
+        if (nodes[task].waiting == 0)
+            ready.push_back(task);
+    for (auto task : ready)
+        schedule(task, *pool);
+
+    // Run pinned tasks, help the pool while there are none
+    while (remaining > 0)
+    {
+        if (!main_ready.empty()) {
+            Task task = main_ready.back();
+            main_ready.pop_back();
+            lock.unlock();
+            execute(task, *pool);
+            lock.lock();
+            continue;
+        }
+
+        lock.unlock();
+        bool helped = pool->run_one();
+        lock.lock();
+
+        if (!helped && remaining > 0 && main_ready.empty())
+            changed.wait(lock);
+    }
+}
+
+void TaskGraph::schedule(Task task, WorkerPool &pool)
+{
+    if (nodes[task].main_thread)
+        main_ready.push_back(task);
+    else
+        pool.submit([this, task, &pool] { execute(task, pool); });
+}
+
+void TaskGraph::execute(Task task, WorkerPool &pool)
+{
+    {
+        PROFILE_ZONE(nodes[task].name);
+        nodes[task].work();
+    }
+
+    std::lock_guard lock(mutex);
+    for (auto next : nodes[task].dependents)
+        if (--nodes[next].waiting == 0)
+            schedule(next, pool);
+
+    remaining--;
+    changed.notify_all();
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads taking jobs from one shared queue
+class WorkerPool {
+public:
+    // Leaves a core to the thread running the graph, it helps out
+    explicit WorkerPool(unsigned threads = default_threads());
+
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    void submit(std::function<void()> job);
+
+    // Run one queued job on the calling thread, false when none is queued
+    bool run_one();
+
+    size_t threads() const { return workers.size(); }
+
+    static unsigned default_threads();
+
+private:
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> jobs;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+// Work of a frame as tasks and the tasks each one waits for. A task runs
+// once all of them finished, on the pool or, when pinned to the main
+// thread, on the thread calling run(). Dependencies are added first.
+class TaskGraph {
+public:
+    using Task = uint32_t;
+
+    Task add(const char *name, std::function<void()> work, std::initializer_list<Task> after = {}, bool main_thread = false);
+
+    Task add(const char *name, std::function<void()> work, const std::vector<Task> &after, bool main_thread = false);
+
+    // Returns once every task ran. Without a pool, or with an empty one,
+    // tasks run here one after the other in the order they were added.
+    void run(WorkerPool *pool);
+
+    // Forget every task, the graph is built again each frame
+    void clear() { nodes.clear(); }
+
+    size_t size() const { return nodes.size(); }
+
+private:
+    struct Node {
+        const char *name;
+        std::function<void()> work;
+        std::vector<Task> dependents;
+        // Dependencies not finished yet
+        uint32_t waiting;
+        bool main_thread;
+    };
+
+    void depend(Task task, Task on);
+
+    // Hand a ready task to the pool or the main thread, mutex held
+    void schedule(Task task, WorkerPool &pool);
+
+    void execute(Task task, WorkerPool &pool);
+
+    std::vector<Node> nodes;
+
+    // Guards waiting counts, main_ready and remaining while running
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<Task> main_ready;
+    size_t remaining = 0;
+};
@@ -2,27 +2,30 @@
 #include <cfloat>
 #include <cmath>
 
+#include "profile.hpp"
 #include "thing.hpp"
 #include "texture.hpp"
 
-constexpr float GRAVITY = 0.001f;
-constexpr float AIR_FRICTION = 0.0002f;
-constexpr float DIRT_FRICTION = 0.008f;
-constexpr float MAX_FALL_SPEED = 1.0f;
-constexpr float MOVE_ACCEL = 0.02f;
-constexpr float MAX_MOVE_SPEED = 0.4f;
-constexpr float JUMP_SPEED = 0.5f;
+// World units are tiles, time is in milliseconds
+constexpr float GRAVITY = 0.00002f;
+constexpr float MAX_FALL_SPEED = 0.02f;
+constexpr float MOVE_ACCEL = 0.0004f;
+constexpr float MAX_MOVE_SPEED = 0.008f;
+constexpr float JUMP_SPEED = 0.01f;
+
+// Still counts as standing where it last landed
+constexpr float LANDING_TOLERANCE = 0.02f;
 
 void Thing::init(SDL_Renderer *renderer, float size)
 {
     this->size = size;
-    texture = load_texture(renderer, "assets/slime.png");
-    pos = {0, 0};
+    texture = renderer ? load_texture(renderer, "assets/slime.png") : nullptr;
+    pos = {};
     vel = {0, 0};
 
-    collider.rect.x = pos.x;
-    collider.rect.y = pos.y;
-    collider.rect.w = collider.rect.h = size;
+    collider.rect.x = pos.x.fixed();
+    collider.rect.y = pos.y.fixed();
+    collider.rect.w = collider.rect.h = to_fixed(size);
 }
 
 void Thing::update(float delta)
@@ -33,49 +36,54 @@ void Thing::update(float delta)
     vel.x += accel.x * delta;
     vel.x = std::clamp(vel.x, -MAX_MOVE_SPEED, MAX_MOVE_SPEED);
 
-    float coeff = on_ground ? DIRT_FRICTION : AIR_FRICTION;
-    apply_friction(vel.x, coeff, delta);
+    // Void friction is the air's
+    apply_friction(vel.x, material_table.friction[ground], delta);
 
-    pos.x += vel.x * delta;
-    pos.y += vel.y * delta;
+    pos.x += to_fixed(vel.x * delta);
+    pos.y += to_fixed(vel.y * delta);
 
-    collider.rect.x = pos.x;
-    collider.rect.y = pos.y;
+    collider.rect.x = pos.x.fixed();
+    collider.rect.y = pos.y.fixed();
 }
 
-static constexpr float RESTITUTION   = 0.5f;
-static constexpr float BOUNCE_CUTOFF = 0.08f;
+// Slower bounces stop dead
+static constexpr float BOUNCE_CUTOFF = 0.0016f;
 
-void Thing::collisions(const Slice<Tile *> &colliding)
+void Thing::collisions(const Slice<Tile> &colliding)
 {
-    for (auto hit : colliding)
+    PROFILE_ZONE("Thing::collisions");
+
+    for (auto &hit : colliding)
     {
-        SDL_FRect b = hit->collider.rect;
-        SDL_FRect inter;
-        SDL_IntersectFRect(&collider.rect, &b, &inter);
+        const FixedRect &a = collider.rect;
+        const FixedRect &b = hit.collider.rect;
 
-        if (inter.w < inter.h) {
+        // Overlap along each axis
+        int64_t inter_w = std::min(a.x + a.w, b.x + b.w) - std::max(a.x, b.x);
+        int64_t inter_h = std::min(a.y + a.h, b.y + b.h) - std::max(a.y, b.y);
+
+        if (inter_w < inter_h) {
             // Horizontal penetration
-            if (pos.x < b.x)
-                pos.x -= inter.w;
+            if (pos.x.fixed() < b.x)
+                pos.x += -inter_w;
             else
-                pos.x += inter.w;
+                pos.x += inter_w;
 
             vel.x = 0.0f;
         } else {
             // Vertical penetration
-            if (pos.y < b.y) {
-                pos.y -= inter.h;
-                land();
-            } else
-                pos.y += inter.h;
-
-            vel.y = 0.0f;
+            if (pos.y.fixed() < b.y) {
+                pos.y += -inter_h;
+                land(hit.material);
+            } else {
+                pos.y += inter_h;
+                vel.y = 0.0f;
+            }
         }
     }
 
-    collider.rect.x = pos.x;
-    collider.rect.y = pos.y;
+    collider.rect.x = pos.x.fixed();
+    collider.rect.y = pos.y.fixed();
 }
 
 void Thing::move_input(float dir)
@@ -92,38 +100,79 @@ void Thing::stop_input()
 
 void Thing::jump()
 {
-    Vec2<float> threshold = {1, 1};
-    auto diff = (pos - landing).abs();
+    Vec2<float> threshold = {LANDING_TOLERANCE, LANDING_TOLERANCE};
+    auto diff = pos.minus(landing).abs();
     if (on_ground || diff < threshold) {
         vel.y -= JUMP_SPEED;
         on_ground = false;
+        ground = M_VOID;
     }
 }
 
-void Thing::land()
+void Thing::land(Material ground)
 {
+    impact = std::max(impact, vel.y);
     on_ground = true;
     landing = pos;
-    vel.y = 0.f;
+    this->ground = ground;
+
+    // Standing across two tiles lands on both, a bounce off the first one
+    // is already moving up and keeps going
+    float bounce = vel.y * material_table.restitution[ground];
+    vel.y = bounce > BOUNCE_CUTOFF ? -bounce : std::min(vel.y, 0.0f);
 }
 
-void Thing::spawn(Vec2<float> pos)
+void Thing::spawn(const WorldPos &pos)
 {
     this->pos = pos;
-    collider.rect.x = pos.x;
-    collider.rect.y = pos.y;
+    collider.rect.x = pos.x.fixed();
+    collider.rect.y = pos.y.fixed();
     vel = {0, 0};
     accel = {0, 0};
     on_ground = false;
+    ground = M_VOID;
+}
+
+ThingState Thing::state() const
+{
+    return {
+        .pos = pos,
+        .vel = vel,
+        .accel = accel,
+        .landing = landing,
+        .facing = facing,
+        .on_ground = on_ground,
+        .ground = ground,
+    };
+}
+
+void Thing::restore(const ThingState &state)
+{
+    pos = state.pos;
+    vel = state.vel;
+    accel = state.accel;
+    landing = state.landing;
+    facing = state.facing;
+    on_ground = state.on_ground;
+    ground = state.ground;
+    collider.rect.x = pos.x.fixed();
+    collider.rect.y = pos.y.fixed();
+}
+
+WorldPos Thing::centre() const
+{
+    int64_t half = to_fixed(size * 0.5f);
+    return { pos.x + half, pos.y + half };
 }
 
-void Thing::render(SDL_Renderer *renderer, const SDL_FRect &camera)
+void Thing::render(SDL_Renderer *renderer, const Camera &camera, float scale)
 {
+    Vec2<float> at = camera.to_screen(pos, scale);
     SDL_FRect dst = {
-        .x = collider.rect.x - camera.x,
-        .y = collider.rect.y - camera.y,
-        .w = collider.rect.w,
-        .h = collider.rect.h,
+        .x = at.x,
+        .y = at.y,
+        .w = size * scale,
+        .h = size * scale,
     };
 
     SDL_RendererFlip flip = facing == F_RIGHT ? SDL_FLIP_NONE : SDL_FLIP_HORIZONTAL;
@@ -8,21 +8,36 @@
 #include "util.hpp"
 #include "vec2.hpp"
 #include "collider.hpp"
+#include "world.hpp"
 
 enum Facing {
     F_LEFT,
     F_RIGHT,
 };
 
+// Everything the simulation needs to resume a Thing
+struct ThingState {
+    WorldPos pos;
+    Vec2<float> vel;
+    Vec2<float> accel;
+    WorldPos landing;
+    Facing facing;
+    bool on_ground;
+    // What it last landed on, void in the air
+    Material ground;
+};
+
 class Thing {
 public:
+    // Size in tiles
     void init(SDL_Renderer *renderer, float size);
 
     void update(float delta);
 
-    void collisions(const Slice<Tile *> &colliding);
+    void collisions(const Slice<Tile> &colliding);
 
-    void render(SDL_Renderer *renderer, const SDL_FRect &camera);
+    // Scale is screen pixels per tile
+    void render(SDL_Renderer *renderer, const Camera &camera, float scale);
 
     void move_input(float dir);
 
@@ -30,21 +45,34 @@ public:
 
     void jump();
 
-    void land();
+    void land(Material ground);
+
+    void spawn(const WorldPos &pos);
+
+    // Middle of its box
+    WorldPos centre() const;
+
+    ThingState state() const;
 
-    void spawn(Vec2<float> pos);
+    void restore(const ThingState &state);
 
-    Vec2<float> pos{};
+    // Fixed point, velocities are small enough for floats in tiles per ms
+    WorldPos pos;
     Vec2<float> vel{};
     float size;
     Facing facing = F_RIGHT;
     Collider collider;
     Vec2<float> accel{0, 0};
     bool on_ground = false;
+    // Picks the friction, void since leaving the ground
+    Material ground = M_VOID;
+    // Fall speed of the hardest landing since someone last zeroed it, for
+    // effects only, it is not part of the state
+    float impact = 0.0f;
 
 private:
     SDL_Texture *texture;
-    Vec2<float> landing{};
+    WorldPos landing;
 
     inline void apply_friction(float& v, float coeff, float delta)
     {
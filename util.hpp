@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <stdexcept>
 #include <vector>
 #include <iostream>
@@ -8,7 +9,12 @@
 #define panic_string(msg)
 #define panic_nostring()
 #define panic_strip(msg, ...) msg
-#define panic(...)	_panic(__FILE__, __func__, __LINE__, "" __VA_ARGS__)
+#define panic(...)	_panic(__FILE__, __func__, __LINE__, panic_message(__VA_ARGS__))
+
+inline const char *panic_message(const char *msg = "")
+{
+	return msg;
+}
 
 inline void _panic(const char *file, const char *func, int line, const char *msg)
 {
@@ -16,6 +22,42 @@ inline void _panic(const char *file, const char *func, int line, const char *msg
 	abort();
 }
 
+constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+inline uint64_t fnv1a(const void *data, size_t len, uint64_t hash = FNV_OFFSET)
+{
+    auto bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+// SplitMix64 finalizer, every input bit affects every output bit
+constexpr uint64_t mix64(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// Small generator for the simulation, its whole state is one u64 so
+// snapshots store it as is
+struct SplitMix64 {
+    using result_type = uint64_t;
+
+    uint64_t state = 0;
+
+    explicit SplitMix64(uint64_t seed = 0) : state(seed) {}
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+
+    result_type operator()() { return mix64(state += 0x9e3779b97f4a7c15ull); }
+};
+
 template<typename T>
 struct Slice {
     T *ptr;
@@ -28,13 +70,13 @@ struct Slice {
 };
 
 
-template<typename T>
+template<typename T, typename Alloc = std::allocator<T>>
 struct Matrix {
-    std::vector<T> data;
+    std::vector<T, Alloc> data;
     size_t rows;
     size_t columns;
 
-    Matrix(size_t r, size_t c) : data(r * c), rows(r), columns(c) {}
+    Matrix(size_t r, size_t c, const Alloc &alloc = Alloc()) : data(r * c, alloc), rows(r), columns(c) {}
 
     void resize(size_t new_rows, size_t new_columns)
     {
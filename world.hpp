@@ -0,0 +1,96 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <cmath>
+#include <cstdint>
+
+#include "vec2.hpp"
+
+// Side of a map chunk in tiles, world positions are relative to chunks too
+constexpr int CHUNK_SIZE = 16;
+
+// Fixed point tiles, Q24 resolves the same 1/16777216 of a tile anywhere
+constexpr int FIXED_BITS = 24;
+constexpr int64_t FIXED_ONE = int64_t(1) << FIXED_BITS;
+
+// Only for small relative amounts, like a step's movement or a distance on screen
+inline int64_t to_fixed(float tiles)
+{
+    return std::llround(double(tiles) * FIXED_ONE);
+}
+
+inline float to_tiles(int64_t fixed)
+{
+    return float(double(fixed) / FIXED_ONE);
+}
+
+// One axis of a position: the chunk and a Q24 offset into it, always in
+// [0, CHUNK_SIZE) tiles. Arithmetic goes through the 64 bit fixed point
+// value, so it is exact and costs the same everywhere in the world.
+struct WorldCoord {
+    int32_t chunk = 0;
+    int32_t offset = 0;
+
+    static constexpr int64_t CHUNK_FIXED = CHUNK_SIZE * FIXED_ONE;
+
+    static WorldCoord at(int64_t fixed)
+    {
+        // Rounds down, left of the origin offsets stay positive
+        int64_t chunk = fixed >= 0 ? fixed / CHUNK_FIXED : (fixed + 1) / CHUNK_FIXED - 1;
+        return { int32_t(chunk), int32_t(fixed - chunk * CHUNK_FIXED) };
+    }
+
+    int64_t fixed() const { return chunk * CHUNK_FIXED + offset; }
+
+    // Offset inside its chunk, anything else only comes from corrupt data
+    bool valid() const { return offset >= 0 && offset < CHUNK_FIXED; }
+
+    // The tile it is in
+    int64_t tile() const { return chunk * int64_t(CHUNK_SIZE) + (offset >> FIXED_BITS); }
+
+    // Tiles from origin, precise as long as the two are near
+    float minus(WorldCoord origin) const { return to_tiles(fixed() - origin.fixed()); }
+
+    WorldCoord operator+(int64_t fixed_delta) const { return at(fixed() + fixed_delta); }
+
+    WorldCoord &operator+=(int64_t fixed_delta) { return *this = at(fixed() + fixed_delta); }
+
+    bool operator==(const WorldCoord &other) const { return chunk == other.chunk && offset == other.offset; }
+
+    bool operator!=(const WorldCoord &other) const { return !(*this == other); }
+};
+
+struct WorldPos {
+    WorldCoord x;
+    WorldCoord y;
+
+    // Top left corner of a tile
+    static WorldPos tile(int64_t column, int64_t row)
+    {
+        return { WorldCoord::at(column * FIXED_ONE), WorldCoord::at(row * FIXED_ONE) };
+    }
+
+    Vec2<float> minus(const WorldPos &origin) const { return { x.minus(origin.x), y.minus(origin.y) }; }
+
+    bool valid() const { return x.valid() && y.valid(); }
+
+    bool operator==(const WorldPos &other) const { return x == other.x && y == other.y; }
+
+    bool operator!=(const WorldPos &other) const { return !(*this == other); }
+};
+
+// What the window shows, its top left corner and its size in tiles
+struct Camera {
+    WorldPos pos;
+    float w = 0.0f;
+    float h = 0.0f;
+
+    // Pixels from the top left of the window, scale is pixels per tile
+    Vec2<float> to_screen(const WorldPos &world, float scale) const { return world.minus(pos) * scale; }
+
+    // In plain float tiles, only for coarse uses like the minimap
+    SDL_FRect tiles() const
+    {
+        return { float(double(pos.x.fixed()) / FIXED_ONE), float(double(pos.y.fixed()) / FIXED_ONE), w, h };
+    }
+};